@@ -0,0 +1,323 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+/** @file InstanceExchange.h
+ *
+ * Support for the superfunpack operators that partition their work by a key
+ * of their own choosing: a flat record buffer, an all-to-all exchange of
+ * those buffers between instances, and a writer that turns unordered output
+ * cells back into a regular array.
+ */
+
+#ifndef INSTANCE_EXCHANGE_H
+#define INSTANCE_EXCHANGE_H
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "query/Operator.h"
+#include "array/MemArray.h"
+
+namespace superfunpack
+{
+
+using namespace scidb;
+
+/* Records bound for one instance, appended to a flat byte buffer. */
+class CellWriter
+{
+  std::vector<char> _data;
+
+public:
+  template<typename T>
+  void write(T const& v)
+  {
+    const char *p = (const char *) &v;
+    _data.insert(_data.end(), p, p + sizeof(T));
+  }
+
+  void writeCoordinates(Coordinates const& pos)
+  {
+    write<uint32_t>(pos.size());
+    for(size_t j = 0; j < pos.size(); ++j) write<Coordinate>(pos[j]);
+  }
+
+  void writeValue(Value const& v)
+  {
+    write<int8_t>(v.isNull() ? 1 : 0);
+    if(v.isNull())
+    {
+      write<int32_t>(v.getMissingReason());
+      return;
+    }
+    write<uint64_t>(v.size());
+    const char *p = (const char *) v.data();
+    _data.insert(_data.end(), p, p + v.size());
+  }
+
+  std::vector<char> const& data() const { return _data; }
+  bool empty() const { return _data.empty(); }
+};
+
+/* Reads back the records of one CellWriter received from some instance. */
+class CellReader
+{
+  std::shared_ptr<SharedBuffer> _buf;
+  const char *_p, *_end;
+
+public:
+  CellReader(std::shared_ptr<SharedBuffer> const& buf) : _buf(buf), _p(NULL), _end(NULL)
+  {
+    if(_buf && _buf->getSize() > 0)
+    {
+      _p = (const char *) _buf->getData();
+      _end = _p + _buf->getSize();
+    }
+  }
+
+  bool end() const { return _p == _end; }
+
+  template<typename T>
+  T read()
+  {
+    T v;
+    memcpy(&v, _p, sizeof(T));
+    _p += sizeof(T);
+    return v;
+  }
+
+  void readCoordinates(Coordinates& pos)
+  {
+    pos.resize(read<uint32_t>());
+    for(size_t j = 0; j < pos.size(); ++j) pos[j] = read<Coordinate>();
+  }
+
+  void readValue(Value& v)
+  {
+    if(read<int8_t>())
+    {
+      v.setNull(read<int32_t>());
+      return;
+    }
+    uint64_t size = read<uint64_t>();
+    v.setData(_p, size);
+    _p += size;
+  }
+};
+
+/* Send outgoing[i] to instance i and return what every instance sent us,
+ * indexed by the sending instance. Every instance must call this the same
+ * number of times, even with nothing to send.
+ */
+inline std::vector<CellReader>
+exchangeCells(std::vector<CellWriter> const& outgoing, std::shared_ptr<Query>& query)
+{
+  size_t const nInstances = query->getInstancesCount();
+  InstanceID const myId = query->getInstanceID();
+  std::vector<CellReader> incoming;
+  for(InstanceID i = 0; i < nInstances; ++i)
+  {
+    if(i == myId) continue;
+    std::shared_ptr<SharedBuffer> buf;
+    if(!outgoing[i].empty())
+    {
+      buf.reset(new MemoryBuffer(&outgoing[i].data()[0], outgoing[i].data().size()));
+    }
+    BufSend(i, buf, query);
+  }
+  for(InstanceID i = 0; i < nInstances; ++i)
+  {
+    if(i == myId)
+    {
+      std::shared_ptr<SharedBuffer> mine;
+      if(!outgoing[i].empty())
+      {
+        mine.reset(new MemoryBuffer(&outgoing[i].data()[0], outgoing[i].data().size()));
+      }
+      incoming.push_back(CellReader(mine));
+    }
+    else incoming.push_back(CellReader(BufReceive(i, query)));
+  }
+  return incoming;
+}
+
+/* Map a 64-bit key to an instance, mixing the bits first so that runs of
+ * consecutive keys spread over all instances.
+ */
+inline InstanceID
+instanceForKey(int64_t key, size_t nInstances)
+{
+  uint64_t h = (uint64_t) key;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h % nInstances;
+}
+
+/* Visit every non-empty cell of the local part of an array, one chunk at a
+ * time, calling f(position, values) with the values of all the attributes
+ * except the empty tag.
+ */
+template<typename F>
+inline void
+scanCells(std::shared_ptr<Array> const& input, F f)
+{
+  Attributes const& attrs = input->getArrayDesc().getAttributes(true);
+  size_t const nAttrs = attrs.size();
+  std::vector<std::shared_ptr<ConstArrayIterator> > aiters(nAttrs);
+  std::vector<std::shared_ptr<ConstChunkIterator> > citers(nAttrs);
+  std::vector<Value> values(nAttrs);
+  for(size_t a = 0; a < nAttrs; ++a) aiters[a] = input->getConstIterator(attrs[a].getId());
+  while(!aiters[0]->end())
+  {
+    for(size_t a = 0; a < nAttrs; ++a)
+    {
+      citers[a] = aiters[a]->getChunk().getConstIterator(
+        ConstChunkIterator::IGNORE_OVERLAPS | ConstChunkIterator::IGNORE_EMPTY_CELLS);
+    }
+    while(!citers[0]->end())
+    {
+      for(size_t a = 0; a < nAttrs; ++a) values[a] = citers[a]->getItem();
+      f(citers[0]->getPosition(), values);
+      for(size_t a = 0; a < nAttrs; ++a) ++(*citers[a]);
+    }
+    for(size_t a = 0; a < nAttrs; ++a) ++(*aiters[a]);
+  }
+}
+
+/* The value of a numeric (or datetime) attribute as a double, NAN for null
+ * values and unsupported types.
+ */
+inline double
+numericValue(Value const& v, TypeId const& type)
+{
+  if(v.isNull())               return NAN;
+  if(type == TID_DOUBLE)       return v.getDouble();
+  if(type == TID_FLOAT)        return v.getFloat();
+  if(type == TID_INT64)        return (double) v.getInt64();
+  if(type == TID_INT32)        return v.getInt32();
+  if(type == TID_UINT64)       return (double) v.getUint64();
+  if(type == TID_UINT32)       return v.getUint32();
+  if(type == TID_DATETIME)     return (double) v.getDateTime();
+  return NAN;
+}
+
+inline bool
+isNumericType(TypeId const& type)
+{
+  return type == TID_DOUBLE || type == TID_FLOAT  || type == TID_INT64 ||
+         type == TID_INT32  || type == TID_UINT64 || type == TID_UINT32 ||
+         type == TID_DATETIME;
+}
+
+/* One output cell: its position and one value per attribute of the output
+ * schema, not counting the empty tag.
+ */
+struct OutputCell
+{
+  Coordinates pos;
+  std::vector<Value> values;
+};
+
+/* Write cells, in any order, into a local array. Each chunk is written
+ * once, so all the cells of a chunk must come in the same call.
+ */
+inline void
+writeCells(std::shared_ptr<MemArray> const& output, std::vector<OutputCell> const& cells, std::shared_ptr<Query> const& query)
+{
+  ArrayDesc const& schema = output->getArrayDesc();
+  Attributes const& attrs = schema.getAttributes(true);
+  size_t const nAttrs = attrs.size();
+
+/* Sequential chunk writes need the cells ordered by chunk, and by position
+ * within each chunk.
+ */
+  std::vector<std::pair<Coordinates, size_t> > order(cells.size());
+  for(size_t j = 0; j < cells.size(); ++j)
+  {
+    order[j].first = cells[j].pos;
+    schema.getChunkPositionFor(order[j].first);
+    order[j].first.insert(order[j].first.end(), cells[j].pos.begin(), cells[j].pos.end());
+    order[j].second = j;
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<std::shared_ptr<ArrayIterator> > aiters(nAttrs);
+  std::vector<std::shared_ptr<ChunkIterator> > citers(nAttrs);
+  for(size_t a = 0; a < nAttrs; ++a) aiters[a] = output->getIterator(attrs[a].getId());
+  size_t const nDims = schema.getDimensions().size();
+  Coordinates chunkPos, lastChunkPos;
+  for(size_t j = 0; j < order.size(); ++j)
+  {
+    OutputCell const& cell = cells[order[j].second];
+    chunkPos.assign(order[j].first.begin(), order[j].first.begin() + nDims);
+    if(j == 0 || chunkPos != lastChunkPos)
+    {
+      for(size_t a = 0; a < nAttrs; ++a)
+      {
+        if(citers[a]) citers[a]->flush();
+/* The first attribute maintains the empty bitmap for the others. */
+        citers[a] = aiters[a]->newChunk(chunkPos).getIterator(query,
+          a == 0 ? ChunkIterator::SEQUENTIAL_WRITE :
+                   ChunkIterator::SEQUENTIAL_WRITE | ChunkIterator::NO_EMPTY_CHECK);
+      }
+      lastChunkPos = chunkPos;
+    }
+    for(size_t a = 0; a < nAttrs; ++a)
+    {
+      citers[a]->setPosition(cell.pos);
+      citers[a]->writeItem(cell.values[a]);
+    }
+  }
+  for(size_t a = 0; a < nAttrs; ++a)
+  {
+    if(citers[a]) citers[a]->flush();
+  }
+}
+
+/* Write cells, in any order, into a new local array with the given schema. */
+inline std::shared_ptr<Array>
+writeCells(ArrayDesc const& schema, std::vector<OutputCell> const& cells, std::shared_ptr<Query> const& query)
+{
+  std::shared_ptr<MemArray> output(new MemArray(schema, query));
+  writeCells(output, cells, query);
+  return output;
+}
+
+/* Return the partial arrays built on every instance by writeCells as one
+ * hash-partitioned array, merging chunks that were written by more than
+ * one instance.
+ */
+inline std::shared_ptr<Array>
+redistributeOutput(std::shared_ptr<Array>& output, std::shared_ptr<Query> const& query)
+{
+  return redistributeToRandomAccess(output, query, psHashPartitioned,
+                                    ALL_INSTANCE_MASK,
+                                    std::shared_ptr<CoordinateTranslator>(), 0,
+                                    std::shared_ptr<PartitioningSchemaData>());
+}
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <set>
+#include <string>
+
+#include "query/Operator.h"
+#include "system/Exceptions.h"
+
+#include "superfunpack.h"
+#include "InstanceExchange.h"
+
+using namespace std;
+using namespace scidb;
+
+/**
+ * @brief The operator: asof_join().
+ *
+ * @par Synopsis:
+ *   asof_join( left_array, right_array, time_attribute, key_dimension, tolerance )
+ *
+ * @par Summary:
+ *   For each cell of the left array (trades, say) find the most recent cell
+ *   of the right array (quotes) with the same key_dimension coordinate (the
+ *   symbol) whose time_attribute value is no later than the left cell's time,
+ *   and at most tolerance earlier. A negative tolerance means no limit.
+ *
+ * @par Input:
+ *   - left_array, right_array: arrays that both have a numeric (or datetime)
+ *     attribute named time_attribute and a dimension named key_dimension,
+ *     time_attribute typically comes from tm2s.
+ *   - time_attribute (string): the name of the time attribute.
+ *   - key_dimension (string): the name of the dimension to match on.
+ *   - tolerance (double): the largest allowed time difference.
+ *
+ * @par Output array:
+ *   The dimensions and attributes of left_array followed by the attributes
+ *   of right_array, made nullable and suffixed with _r where their names
+ *   collide with those of the left array, as many times as it takes to make
+ *   them unique. Left cells without a match have
+ *   null right attributes.
+ *
+ * @par Examples:
+ *   asof_join(apply(trades, t, tm2s(time)), apply(quotes, t, tm2s(time)), 't', 'symbol_id', 5)
+ */
+class LogicalAsofJoin : public LogicalOperator
+{
+public:
+  LogicalAsofJoin(const string& logicalName, const string& alias):
+    LogicalOperator(logicalName, alias)
+  {
+    ADD_PARAM_INPUT()
+    ADD_PARAM_INPUT()
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("double")
+  }
+
+  ArrayDesc inferSchema(vector<ArrayDesc> schemas, std::shared_ptr<Query> query)
+  {
+    ArrayDesc const& left  = schemas[0];
+    ArrayDesc const& right = schemas[1];
+    string timeAttr = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[0])->getExpression(),
+                               query, TID_STRING).getString();
+    string keyDim   = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[1])->getExpression(),
+                               query, TID_STRING).getString();
+    for(size_t i = 0; i < 2; ++i)
+    {
+      ArrayDesc const& in = schemas[i];
+      Attributes const& attrs = in.getAttributes(true);
+      bool found = false;
+      for(size_t a = 0; a < attrs.size() && !found; ++a)
+      {
+        if(attrs[a].getName() != timeAttr) continue;
+        if(!superfunpack::isNumericType(attrs[a].getType()))
+        {
+          throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ASOF_JOIN)
+            << ("attribute " + timeAttr + " of " + in.getName() + " is not numeric");
+        }
+        found = true;
+      }
+      if(!found)
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ASOF_JOIN)
+          << (in.getName() + " has no attribute " + timeAttr);
+      }
+      found = false;
+      Dimensions const& dims = in.getDimensions();
+      for(size_t d = 0; d < dims.size() && !found; ++d)
+      {
+        found = dims[d].hasNameAndAlias(keyDim);
+      }
+      if(!found)
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ASOF_JOIN)
+          << (in.getName() + " has no dimension " + keyDim);
+      }
+    }
+
+    Attributes outAttrs;
+    Attributes const& leftAttrs  = left.getAttributes(true);
+    Attributes const& rightAttrs = right.getAttributes(true);
+    AttributeID id = 0;
+    for(size_t a = 0; a < leftAttrs.size(); ++a, ++id)
+    {
+      outAttrs.push_back(AttributeDesc(id, leftAttrs[a].getName(), leftAttrs[a].getType(),
+                                       leftAttrs[a].getFlags(),
+                                       leftAttrs[a].getDefaultCompressionMethod()));
+    }
+    set<string> taken;
+    for(size_t a = 0; a < leftAttrs.size(); ++a)  taken.insert(leftAttrs[a].getName());
+    for(size_t a = 0; a < rightAttrs.size(); ++a) taken.insert(rightAttrs[a].getName());
+    for(size_t a = 0; a < rightAttrs.size(); ++a, ++id)
+    {
+/* Rename right attributes that collide with left ones to a name that is
+ * neither a left nor a right name nor an earlier rename.
+ */
+      string name = rightAttrs[a].getName();
+      bool collides = false;
+      for(size_t b = 0; b < leftAttrs.size() && !collides; ++b)
+      {
+        collides = leftAttrs[b].getName() == name;
+      }
+      if(collides)
+      {
+        while(taken.count(name)) name += "_r";
+        taken.insert(name);
+      }
+      outAttrs.push_back(AttributeDesc(id, name, rightAttrs[a].getType(),
+                                       rightAttrs[a].getFlags() | AttributeDesc::IS_NULLABLE,
+                                       rightAttrs[a].getDefaultCompressionMethod()));
+    }
+    outAttrs.push_back(AttributeDesc(id, DEFAULT_EMPTY_TAG_ATTRIBUTE_NAME, TID_INDICATOR,
+                                     AttributeDesc::IS_EMPTY_INDICATOR, 0));
+    return ArrayDesc(left.getName() + "_asof", outAttrs, left.getDimensions());
+  }
+};
+
+REGISTER_LOGICAL_OPERATOR_FACTORY(LogicalAsofJoin, "asof_join");
@@ -0,0 +1,164 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <math.h>
+
+#include "query/Operator.h"
+#include "system/Exceptions.h"
+
+#include "superfunpack.h"
+#include "InstanceExchange.h"
+
+using namespace std;
+using namespace scidb;
+
+/**
+ * @brief The operator: book_replay().
+ *
+ * @par Synopsis:
+ *   book_replay( messages, symbol_dimension, time_dimension, depth [, interval [, tick]] )
+ *
+ * @par Summary:
+ *   Rebuild order books from a feed of incremental order messages. The
+ *   messages of each symbol_dimension coordinate are replayed in
+ *   time_dimension order (ties broken by the other dimensions), and the book
+ *   after each message is written, limited to depth levels per side, as a
+ *   binary book at the position of the message.
+ *
+ *   With a positive interval only the last snapshot of each symbol in each
+ *   interval of time_dimension coordinates is written, for instance one
+ *   book per second from millisecond message times.
+ *
+ * @par Input:
+ *   - messages: an array with the attributes
+ *       order_id (int64 or other numeric)  the order the message refers to
+ *       action (string)  add, modify, delete or execute, only the first
+ *                        letter matters
+ *       side (string)    buy/bid or sell/ask, only the first letter matters
+ *       price (numeric)  the order price, used by add and modify
+ *       size (numeric)   the order size for add and modify, the executed
+ *                        size for execute
+ *   - symbol_dimension (string): the name of the symbol dimension.
+ *   - time_dimension (string): the name of the time dimension.
+ *   - depth (int64): the number of levels kept per side in the snapshots.
+ *   - interval (int64): optional sampling interval, 0 (the default) writes
+ *     a snapshot for every message.
+ *   - tick (double): optional price tick size, 0.001 by default.
+ *
+ *   Modify replaces an order's price and size (null keeps the old value) on
+ *   its original side, execute removes the executed size from the order and
+ *   delete removes the whole order. Messages for unknown orders are ignored.
+ *
+ * @par Output array:
+ *   The dimensions of messages with a single attribute, book, of the binary
+ *   book type. Convert it with string(book) for the string book format.
+ *
+ * @par Examples:
+ *   book_replay(messages, 'symbol_id', 'ms', 10, 1000)
+ */
+class LogicalBookReplay : public LogicalOperator
+{
+public:
+  LogicalBookReplay(const string& logicalName, const string& alias):
+    LogicalOperator(logicalName, alias)
+  {
+    ADD_PARAM_INPUT()
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("int64")
+    ADD_PARAM_VARIES()
+  }
+
+  vector<std::shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(vector<ArrayDesc> const&)
+  {
+    vector<std::shared_ptr<OperatorParamPlaceholder> > res;
+    res.push_back(END_OF_VARIES_PARAMS());
+    if(_parameters.size() == 3) res.push_back(PARAM_CONSTANT("int64"));
+    else if(_parameters.size() == 4) res.push_back(PARAM_CONSTANT("double"));
+    return res;
+  }
+
+  ArrayDesc inferSchema(vector<ArrayDesc> schemas, std::shared_ptr<Query> query)
+  {
+    ArrayDesc const& in = schemas[0];
+    Attributes const& attrs = in.getAttributes(true);
+    Dimensions const& dims = in.getDimensions();
+    char const *names[] = {"order_id", "action", "side", "price", "size"};
+    for(size_t i = 0; i < 5; ++i)
+    {
+      bool found = false;
+      for(size_t a = 0; a < attrs.size() && !found; ++a)
+      {
+        if(attrs[a].getName() != names[i]) continue;
+        bool text = i == 1 || i == 2;
+        if(text ? attrs[a].getType() != TID_STRING : !superfunpack::isNumericType(attrs[a].getType()))
+        {
+          throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_REPLAY)
+            << ("attribute " + string(names[i]) + " of " + in.getName() + " is not " +
+                (text ? "a string" : "numeric"));
+        }
+        found = true;
+      }
+      if(!found)
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_REPLAY)
+          << (in.getName() + " has no attribute " + names[i]);
+      }
+    }
+    for(size_t i = 0; i < 2; ++i)
+    {
+      string dim = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[i])->getExpression(),
+                            query, TID_STRING).getString();
+      bool found = false;
+      for(size_t d = 0; d < dims.size() && !found; ++d)
+      {
+        found = dims[d].hasNameAndAlias(dim);
+      }
+      if(!found)
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_REPLAY)
+          << (in.getName() + " has no dimension " + dim);
+      }
+    }
+    int64_t depth = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[2])->getExpression(),
+                             query, TID_INT64).getInt64();
+    if(depth <= 0)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_REPLAY)
+        << "depth must be positive";
+    }
+    if(_parameters.size() > 4)
+    {
+      double tick = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[4])->getExpression(),
+                             query, TID_DOUBLE).getDouble();
+      if(!(tick > 0) || !isfinite(tick))
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_REPLAY)
+          << "tick must be positive and finite";
+      }
+    }
+
+    Attributes outAttrs;
+    outAttrs.push_back(AttributeDesc(0, "book", "book", 0, 0));
+    outAttrs.push_back(AttributeDesc(1, DEFAULT_EMPTY_TAG_ATTRIBUTE_NAME, TID_INDICATOR,
+                                     AttributeDesc::IS_EMPTY_INDICATOR, 0));
+    return ArrayDesc(in.getName() + "_book", outAttrs, dims);
+  }
+};
+
+REGISTER_LOGICAL_OPERATOR_FACTORY(LogicalBookReplay, "book_replay");
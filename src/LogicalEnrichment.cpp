@@ -0,0 +1,132 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include "query/Operator.h"
+#include "system/Exceptions.h"
+
+#include "superfunpack.h"
+#include "InstanceExchange.h"
+
+using namespace std;
+using namespace scidb;
+
+/**
+ * @brief The operator: enrichment().
+ *
+ * @par Synopsis:
+ *   enrichment( array, overlap_attribute, set_size_attribute,
+ *               list_size_attribute, universe_attribute, list_dimension )
+ *
+ * @par Summary:
+ *   The hypergeometric over-representation test of gene set enrichment, one
+ *   test per cell: the probability of an overlap at least as large as the
+ *   observed one between a set of set_size genes and a list of list_size
+ *   genes drawn from a universe of universe genes, that is
+ *   phyper(overlap - 1, set_size, universe - set_size, list_size, false).
+ *   The p-values are also adjusted with Benjamini-Hochberg within each
+ *   family, the tests of one list against a collection of sets, which share
+ *   a list_dimension coordinate.
+ *
+ * @par Input:
+ *   - array: an array with the four numeric attributes named below.
+ *   - overlap_attribute (string): the genes in both the set and the list.
+ *   - set_size_attribute (string): the genes in the set.
+ *   - list_size_attribute (string): the genes in the list.
+ *   - universe_attribute (string): the genes in the universe.
+ *   - list_dimension (string): the dimension that tells the lists apart.
+ *
+ * @par Output array:
+ *   The dimensions and attributes of array, followed by two nullable double
+ *   attributes: p_value and p_adjusted. They are null where any of the four
+ *   inputs is null, and NaN where the four do not make a table.
+ *
+ * @par Examples:
+ *   enrichment(overlaps, 'x', 'set_size', 'list_size', 'N', 'sample')
+ */
+class LogicalEnrichment : public LogicalOperator
+{
+public:
+  LogicalEnrichment(const string& logicalName, const string& alias):
+    LogicalOperator(logicalName, alias)
+  {
+    ADD_PARAM_INPUT()
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+  }
+
+  ArrayDesc inferSchema(vector<ArrayDesc> schemas, std::shared_ptr<Query> query)
+  {
+    ArrayDesc const& in = schemas[0];
+    Attributes const& attrs = in.getAttributes(true);
+    for(size_t j = 0; j < 4; ++j)
+    {
+      string name = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[j])->getExpression(),
+                             query, TID_STRING).getString();
+      size_t a = 0;
+      while(a < attrs.size() && attrs[a].getName() != name) ++a;
+      if(a == attrs.size())
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ENRICHMENT)
+          << (in.getName() + " has no attribute " + name);
+      }
+      if(!superfunpack::isNumericType(attrs[a].getType()))
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ENRICHMENT)
+          << ("attribute " + name + " of " + in.getName() + " is not numeric");
+      }
+    }
+    string listDim = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[4])->getExpression(),
+                              query, TID_STRING).getString();
+    Dimensions const& dims = in.getDimensions();
+    bool found = false;
+    for(size_t d = 0; d < dims.size() && !found; ++d)
+    {
+      found = dims[d].hasNameAndAlias(listDim);
+    }
+    if(!found)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ENRICHMENT)
+        << (in.getName() + " has no dimension " + listDim);
+    }
+
+    Attributes outAttrs;
+    for(size_t a = 0; a < attrs.size(); ++a)
+    {
+      if(attrs[a].getName() == "p_value" || attrs[a].getName() == "p_adjusted")
+      {
+        throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_ENRICHMENT)
+          << (in.getName() + " already has an attribute " + attrs[a].getName());
+      }
+      outAttrs.push_back(AttributeDesc(a, attrs[a].getName(), attrs[a].getType(),
+                                       attrs[a].getFlags(),
+                                       attrs[a].getDefaultCompressionMethod()));
+    }
+    outAttrs.push_back(AttributeDesc(attrs.size(), "p_value", TID_DOUBLE,
+                                     AttributeDesc::IS_NULLABLE, 0));
+    outAttrs.push_back(AttributeDesc(attrs.size() + 1, "p_adjusted", TID_DOUBLE,
+                                     AttributeDesc::IS_NULLABLE, 0));
+    outAttrs.push_back(AttributeDesc(attrs.size() + 2, DEFAULT_EMPTY_TAG_ATTRIBUTE_NAME, TID_INDICATOR,
+                                     AttributeDesc::IS_EMPTY_INDICATOR, 0));
+    return ArrayDesc(in.getName(), outAttrs, in.getDimensions());
+  }
+};
+
+REGISTER_LOGICAL_OPERATOR_FACTORY(LogicalEnrichment, "enrichment");
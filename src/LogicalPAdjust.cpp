@@ -0,0 +1,117 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <strings.h>
+
+#include "query/Operator.h"
+#include "system/Exceptions.h"
+
+#include "superfunpack.h"
+#include "InstanceExchange.h"
+
+using namespace std;
+using namespace scidb;
+
+/**
+ * @brief The operator: p_adjust().
+ *
+ * @par Synopsis:
+ *   p_adjust( array, pvalue_attribute, method )
+ *
+ * @par Summary:
+ *   Adjust the p-values in pvalue_attribute for multiple comparisons across
+ *   the whole array, like R's p.adjust. The number of comparisons is the
+ *   number of cells with a non-null, non-NaN p-value.
+ *
+ * @par Input:
+ *   - array: an array with a numeric attribute named pvalue_attribute.
+ *   - pvalue_attribute (string): the name of the p-value attribute.
+ *   - method (string): one of bonferroni, holm, hochberg, BH (or fdr), BY
+ *     or none, in any case.
+ *
+ * @par Output array:
+ *   The dimensions and attributes of array, with the values of
+ *   pvalue_attribute replaced by the adjusted p-values as doubles. Null and
+ *   NaN p-values are left as they are.
+ *
+ * @par Examples:
+ *   p_adjust(apply(tables, p, fishertest_p_value(x, m, n, k, 'two.sided')), 'p', 'BH')
+ */
+class LogicalPAdjust : public LogicalOperator
+{
+public:
+  LogicalPAdjust(const string& logicalName, const string& alias):
+    LogicalOperator(logicalName, alias)
+  {
+    ADD_PARAM_INPUT()
+    ADD_PARAM_CONSTANT("string")
+    ADD_PARAM_CONSTANT("string")
+  }
+
+  ArrayDesc inferSchema(vector<ArrayDesc> schemas, std::shared_ptr<Query> query)
+  {
+    ArrayDesc const& in = schemas[0];
+    Attributes const& attrs = in.getAttributes(true);
+    string pvalue = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[0])->getExpression(),
+                             query, TID_STRING).getString();
+    string method = evaluate(((std::shared_ptr<OperatorParamLogicalExpression>&)_parameters[1])->getExpression(),
+                             query, TID_STRING).getString();
+    char const *methods[] = {"bonferroni", "holm", "hochberg", "BH", "fdr", "BY", "none"};
+    bool found = false;
+    for(size_t i = 0; i < sizeof(methods)/sizeof(methods[0]) && !found; ++i)
+    {
+      found = strcasecmp(method.c_str(), methods[i]) == 0;
+    }
+    if(!found)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_P_ADJUST)
+        << ("unknown method " + method);
+    }
+
+    Attributes outAttrs;
+    found = false;
+    for(size_t a = 0; a < attrs.size(); ++a)
+    {
+      if(attrs[a].getName() == pvalue)
+      {
+        if(!superfunpack::isNumericType(attrs[a].getType()))
+        {
+          throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_P_ADJUST)
+            << ("attribute " + pvalue + " of " + in.getName() + " is not numeric");
+        }
+        outAttrs.push_back(AttributeDesc(a, pvalue, TID_DOUBLE, attrs[a].getFlags(),
+                                         attrs[a].getDefaultCompressionMethod()));
+        found = true;
+        continue;
+      }
+      outAttrs.push_back(AttributeDesc(a, attrs[a].getName(), attrs[a].getType(),
+                                       attrs[a].getFlags(),
+                                       attrs[a].getDefaultCompressionMethod()));
+    }
+    if(!found)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_P_ADJUST)
+        << (in.getName() + " has no attribute " + pvalue);
+    }
+    outAttrs.push_back(AttributeDesc(attrs.size(), DEFAULT_EMPTY_TAG_ATTRIBUTE_NAME, TID_INDICATOR,
+                                     AttributeDesc::IS_EMPTY_INDICATOR, 0));
+    return ArrayDesc(in.getName(), outAttrs, in.getDimensions());
+  }
+};
+
+REGISTER_LOGICAL_OPERATOR_FACTORY(LogicalPAdjust, "p_adjust");
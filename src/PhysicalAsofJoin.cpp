@@ -0,0 +1,224 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "query/Operator.h"
+#include "array/MemArray.h"
+
+#include "InstanceExchange.h"
+
+using namespace std;
+using namespace scidb;
+using namespace superfunpack;
+
+/* The as-of join runs in three steps:
+ *
+ * 1. Every instance reads its local chunks of both inputs and ships each cell
+ *    to the instance that owns its key (symbol), so that all the trades and
+ *    quotes of a symbol end up on one instance.
+ * 2. Each instance sorts what it received by (key, time) and merges the left
+ *    and right streams of every key in a single linear pass.
+ * 3. The joined cells are written at their left array positions and the
+ *    partial results are redistributed into a regular array.
+ *
+ * The merge cannot run chunk by chunk over the inputs: the time is an
+ * attribute, so the chunk order says nothing about the time order, and the
+ * cells of one key arrive from every instance. Each instance therefore holds
+ * the cells of its keys, about the size of its share of both inputs, once:
+ * the left values move into the output cells rather than being copied.
+ */
+class PhysicalAsofJoin : public PhysicalOperator
+{
+/* A cell of either input as seen by the merge. Right cells carry their
+ * position only to break ties between equal times deterministically.
+ */
+  struct Tick
+  {
+    int64_t key;
+    double time;
+    Coordinates pos;
+    vector<Value> values;
+  };
+
+  struct TickOrder
+  {
+    bool operator()(Tick const* a, Tick const* b) const
+    {
+      if(a->key != b->key) return a->key < b->key;
+      if(a->time != b->time) return a->time < b->time;
+      return a->pos < b->pos;
+    }
+  };
+
+  static size_t attributeIndex(ArrayDesc const& schema, string const& name)
+  {
+    Attributes const& attrs = schema.getAttributes(true);
+    for(size_t a = 0; a < attrs.size(); ++a)
+    {
+      if(attrs[a].getName() == name) return a;
+    }
+    return attrs.size();
+  }
+
+  static size_t dimensionIndex(ArrayDesc const& schema, string const& name)
+  {
+    Dimensions const& dims = schema.getDimensions();
+    for(size_t d = 0; d < dims.size(); ++d)
+    {
+      if(dims[d].hasNameAndAlias(name)) return d;
+    }
+    return dims.size();
+  }
+
+/* Ship every local cell of input to the instance owning its key. */
+  static void shipCells(std::shared_ptr<Array> const& input, string const& timeAttr,
+                        string const& keyDim, vector<CellWriter>& outgoing)
+  {
+    ArrayDesc const& schema = input->getArrayDesc();
+    size_t const t = attributeIndex(schema, timeAttr);
+    size_t const k = dimensionIndex(schema, keyDim);
+    TypeId const timeType = schema.getAttributes(true)[t].getType();
+    size_t const nInstances = outgoing.size();
+    scanCells(input, [&](Coordinates const& pos, vector<Value> const& values)
+    {
+      CellWriter& out = outgoing[instanceForKey(pos[k], nInstances)];
+      out.write<int64_t>(pos[k]);
+      out.write<double>(numericValue(values[t], timeType));
+      out.writeCoordinates(pos);
+      for(size_t a = 0; a < values.size(); ++a) out.writeValue(values[a]);
+    });
+  }
+
+  static void receiveCells(vector<CellReader>& incoming, size_t nAttrs, vector<Tick>& ticks)
+  {
+    for(size_t i = 0; i < incoming.size(); ++i)
+    {
+      CellReader& in = incoming[i];
+      while(!in.end())
+      {
+        ticks.push_back(Tick());
+        Tick& tick = ticks.back();
+        tick.key  = in.read<int64_t>();
+        tick.time = in.read<double>();
+        in.readCoordinates(tick.pos);
+        tick.values.resize(nAttrs);
+        for(size_t a = 0; a < nAttrs; ++a) in.readValue(tick.values[a]);
+      }
+    }
+  }
+
+/* Put the non-null-time ticks in (key, time) order. */
+  static void sortTicks(vector<Tick> const& ticks, vector<Tick const*>& order)
+  {
+    order.clear();
+    order.reserve(ticks.size());
+    for(size_t j = 0; j < ticks.size(); ++j)
+    {
+      if(!isnan(ticks[j].time)) order.push_back(&ticks[j]);
+    }
+    sort(order.begin(), order.end(), TickOrder());
+  }
+
+public:
+  PhysicalAsofJoin(string const& logicalName, string const& physicalName,
+                   Parameters const& parameters, ArrayDesc const& schema):
+    PhysicalOperator(logicalName, physicalName, parameters, schema)
+  {}
+
+  virtual bool changesDistribution(vector<ArrayDesc> const&) const
+  {
+    return true;
+  }
+
+  virtual RedistributeContext getOutputDistribution(vector<RedistributeContext> const&,
+                                                    vector<ArrayDesc> const&) const
+  {
+    return RedistributeContext(psHashPartitioned);
+  }
+
+  std::shared_ptr<Array> execute(vector< std::shared_ptr<Array> >& inputArrays, std::shared_ptr<Query> query)
+  {
+    string timeAttr  = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()->evaluate().getString();
+    string keyDim    = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[1])->getExpression()->evaluate().getString();
+    double tolerance = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[2])->getExpression()->evaluate().getDouble();
+    if(tolerance < 0) tolerance = INFINITY;
+    size_t const nInstances = query->getInstancesCount();
+    size_t const nLeft  = inputArrays[0]->getArrayDesc().getAttributes(true).size();
+    size_t const nRight = inputArrays[1]->getArrayDesc().getAttributes(true).size();
+
+    vector<Tick> left, right;
+    {
+      vector<CellWriter> outgoing(nInstances);
+      shipCells(inputArrays[0], timeAttr, keyDim, outgoing);
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      receiveCells(incoming, nLeft, left);
+    }
+    {
+      vector<CellWriter> outgoing(nInstances);
+      shipCells(inputArrays[1], timeAttr, keyDim, outgoing);
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      receiveCells(incoming, nRight, right);
+    }
+    vector<Tick const*> lorder, rorder;
+    sortTicks(left, lorder);
+    sortTicks(right, rorder);
+
+    Value missing;
+    missing.setNull(0);
+    vector<OutputCell> cells(left.size());
+    for(size_t j = 0; j < left.size(); ++j)
+    {
+      cells[j].pos.swap(left[j].pos);
+      cells[j].values.swap(left[j].values);
+      cells[j].values.resize(nLeft + nRight, missing);
+    }
+
+/* Both streams are in (key, time) order: advance the right cursor past all
+ * the quotes at or before each trade, the last one passed is the match.
+ */
+    size_t r = 0;
+    for(size_t l = 0; l < lorder.size(); ++l)
+    {
+      Tick const& trade = *lorder[l];
+      while(r < rorder.size() && rorder[r]->key < trade.key) ++r;
+      Tick const* quote = NULL;
+      while(r < rorder.size() && rorder[r]->key == trade.key && rorder[r]->time <= trade.time)
+      {
+        quote = rorder[r];
+        ++r;
+      }
+/* The next trade of this key may still match the same quote. */
+      if(quote) --r;
+      if(!quote || trade.time - quote->time > tolerance) continue;
+      OutputCell& cell = cells[&trade - &left[0]];
+      copy(quote->values.begin(), quote->values.end(), cell.values.begin() + nLeft);
+    }
+    left.clear();
+    right.clear();
+    lorder.clear();
+    rorder.clear();
+
+    std::shared_ptr<Array> output = writeCells(_schema, cells, query);
+    return redistributeOutput(output, query);
+  }
+};
+
+REGISTER_PHYSICAL_OPERATOR_FACTORY(PhysicalAsofJoin, "asof_join", "PhysicalAsofJoin");
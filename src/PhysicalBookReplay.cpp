@@ -0,0 +1,438 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <ctype.h>
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+#include "query/Operator.h"
+#include "array/MemArray.h"
+
+#include "InstanceExchange.h"
+#include "book.h"
+
+using namespace std;
+using namespace scidb;
+using namespace superfunpack;
+
+/* The book replay runs in three steps:
+ *
+ * 1. Every instance reads its local messages and ships each one to the
+ *    instance that owns its symbol, so that all the messages of a symbol end
+ *    up on one instance.
+ * 2. Each instance sorts what it received by (symbol, time) and replays
+ *    its symbols, each into its own book, on up to BOOK_REPLAY_THREADS
+ *    threads. Each thread replays the symbols of one row of output chunks
+ *    along the symbol dimension, and the threads take the rows in batches
+ *    of one row per thread.
+ * 3. The snapshots of each batch are written at their message positions
+ *    once the whole batch is replayed, so an instance holds the snapshots
+ *    of at most BOOK_REPLAY_THREADS rows of chunks. The partial results
+ *    are then redistributed into a regular array.
+ */
+
+/* The most threads replaying symbols on one instance. The other instances
+ * replay their own symbols at the same time, so this stays small.
+ */
+#define BOOK_REPLAY_THREADS 4u
+
+class PhysicalBookReplay : public PhysicalOperator
+{
+  struct Message
+  {
+    int64_t key;
+    int64_t time;
+    Coordinates pos;
+    int64_t order;
+    double price;
+    double size;
+    char action;    // 'A', 'M', 'D' or 'E'
+    char side;      // 'B' for bids, 'S' for asks
+  };
+
+  struct MessageOrder
+  {
+    bool operator()(Message const* a, Message const* b) const
+    {
+      if(a->key != b->key) return a->key < b->key;
+      if(a->time != b->time) return a->time < b->time;
+      return a->pos < b->pos;
+    }
+  };
+
+/* The live orders and price levels of one symbol. The levels of each side
+ * are kept in a flat array sorted worst price first, so the busy top of the
+ * book sits at the end of the array where inserts and deletes move the
+ * fewest levels. A level is keyed by its price in ticks and lives as long
+ * as it has orders, so sizes that round off to a tiny remainder, like
+ * 0.1 + 0.2 - 0.3, leave no empty level behind.
+ */
+  class ReplayBook
+  {
+    struct Order
+    {
+      int64_t price;
+      double size;
+      bool bid;
+    };
+
+    struct Level
+    {
+      int64_t price;
+      double size;
+      size_t orders;
+    };
+
+    unordered_map<int64_t, Order> _orders;
+    vector<Level> _bid;    // increasing prices
+    vector<Level> _ask;    // decreasing prices
+    double _tick;
+
+    static bool lowerBid(Level const& l, int64_t price) { return l.price < price; }
+    static bool higherAsk(Level const& l, int64_t price) { return l.price > price; }
+
+/* Add an order of size to a price level, or take one away */
+    void change(bool bid, int64_t price, double size, bool add)
+    {
+      vector<Level>& side = bid ? _bid : _ask;
+      vector<Level>::iterator l = bid ? lower_bound(side.begin(), side.end(), price, lowerBid)
+                                      : lower_bound(side.begin(), side.end(), price, higherAsk);
+      if(l != side.end() && l->price == price)
+      {
+        if(add)
+        {
+          l->size += size;
+          ++l->orders;
+        }
+        else if(--l->orders == 0) side.erase(l);
+        else l->size -= size;
+      } else if(add)
+      {
+        Level level = {price, size, 1};
+        side.insert(l, level);
+      }
+    }
+
+/* Take size away from a level without removing any of its orders */
+    void reduce(bool bid, int64_t price, double size)
+    {
+      vector<Level>& side = bid ? _bid : _ask;
+      vector<Level>::iterator l = bid ? lower_bound(side.begin(), side.end(), price, lowerBid)
+                                      : lower_bound(side.begin(), side.end(), price, higherAsk);
+      if(l != side.end() && l->price == price) l->size -= size;
+    }
+
+    bool ticks(double price, int64_t *t) const
+    {
+      if(!(fabs(price / _tick) < 9e18)) return false;
+      *t = llround(price / _tick);
+      return true;
+    }
+
+  public:
+    ReplayBook(double tick): _tick(tick) {}
+
+    void apply(Message const& m)
+    {
+      unordered_map<int64_t, Order>::iterator o = _orders.find(m.order);
+      int64_t price;
+      switch(m.action)
+      {
+        case 'A':
+          if(m.side != 'B' && m.side != 'S') return;
+          if(!ticks(m.price, &price) || !(m.size > 0)) return;
+          if(o != _orders.end())
+          {
+            change(o->second.bid, o->second.price, o->second.size, false);
+            _orders.erase(o);
+          }
+          {
+            Order order = {price, m.size, m.side == 'B'};
+            _orders[m.order] = order;
+          }
+          change(m.side == 'B', price, m.size, true);
+          break;
+        case 'M':
+          if(o == _orders.end()) return;
+          change(o->second.bid, o->second.price, o->second.size, false);
+          if(ticks(m.price, &price)) o->second.price = price;
+          if(!isnan(m.size)) o->second.size = m.size;
+          if(o->second.size > 0) change(o->second.bid, o->second.price, o->second.size, true);
+          else _orders.erase(o);
+          break;
+        case 'D':
+          if(o == _orders.end()) return;
+          change(o->second.bid, o->second.price, o->second.size, false);
+          _orders.erase(o);
+          break;
+        case 'E':
+          if(o == _orders.end() || !(m.size > 0)) return;
+          if(m.size >= o->second.size)
+          {
+            change(o->second.bid, o->second.price, o->second.size, false);
+            _orders.erase(o);
+          }
+          else
+          {
+            reduce(o->second.bid, o->second.price, m.size);
+            o->second.size -= m.size;
+          }
+          break;
+      }
+    }
+
+/* Write the best depth levels of each side as a binary book */
+    void snapshot(uint32_t depth, vector<char>& buf, Value& out) const
+    {
+      uint32_t nbid = min<size_t>(_bid.size(), depth);
+      uint32_t nask = min<size_t>(_ask.size(), depth);
+      buf.resize(sizeof(book_header) + (nbid + nask) * sizeof(book_level));
+      book_header *h = (book_header *) &buf[0];
+      book_level *level = (book_level *) (h + 1);
+      h->tick = _tick;
+      h->nbid = nbid;
+      h->nask = nask;
+      h->depth = depth;
+      h->reserved = 0;
+      for(uint32_t j = 0; j < nbid; ++j)
+      {
+        level[j].price = _bid[_bid.size() - 1 - j].price;
+        level[j].size  = _bid[_bid.size() - 1 - j].size;
+      }
+      for(uint32_t j = 0; j < nask; ++j)
+      {
+        level[nbid + j].price = _ask[_ask.size() - 1 - j].price;
+        level[nbid + j].size  = _ask[_ask.size() - 1 - j].size;
+      }
+      out.setData(&buf[0], buf.size());
+    }
+  };
+
+  static size_t attributeIndex(ArrayDesc const& schema, string const& name)
+  {
+    Attributes const& attrs = schema.getAttributes(true);
+    for(size_t a = 0; a < attrs.size(); ++a)
+    {
+      if(attrs[a].getName() == name) return a;
+    }
+    return attrs.size();
+  }
+
+  static size_t dimensionIndex(ArrayDesc const& schema, string const& name)
+  {
+    Dimensions const& dims = schema.getDimensions();
+    for(size_t d = 0; d < dims.size(); ++d)
+    {
+      if(dims[d].hasNameAndAlias(name)) return d;
+    }
+    return dims.size();
+  }
+
+/* Order ids are compared exactly, so keep 64-bit integer ids as they are */
+  static int64_t orderId(Value const& v, TypeId const& type)
+  {
+    if(type == TID_INT64)  return v.getInt64();
+    if(type == TID_UINT64) return (int64_t) v.getUint64();
+    return (int64_t) numericValue(v, type);
+  }
+
+  static int64_t floorDiv(int64_t a, int64_t b)
+  {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+  }
+
+/* Ship every local message to the instance owning its symbol. Messages
+ * with a null order id or action are dropped here.
+ */
+  static void shipMessages(std::shared_ptr<Array> const& input, string const& keyDim,
+                           string const& timeDim, vector<CellWriter>& outgoing)
+  {
+    ArrayDesc const& schema = input->getArrayDesc();
+    Attributes const& attrs = schema.getAttributes(true);
+    size_t const k = dimensionIndex(schema, keyDim);
+    size_t const t = dimensionIndex(schema, timeDim);
+    size_t const id     = attributeIndex(schema, "order_id");
+    size_t const action = attributeIndex(schema, "action");
+    size_t const side   = attributeIndex(schema, "side");
+    size_t const price  = attributeIndex(schema, "price");
+    size_t const size   = attributeIndex(schema, "size");
+    size_t const nInstances = outgoing.size();
+    scanCells(input, [&](Coordinates const& pos, vector<Value> const& values)
+    {
+      if(values[id].isNull() || values[action].isNull()) return;
+      CellWriter& out = outgoing[instanceForKey(pos[k], nInstances)];
+      out.write<int64_t>(pos[k]);
+      out.write<int64_t>(pos[t]);
+      out.writeCoordinates(pos);
+      out.write<int64_t>(orderId(values[id], attrs[id].getType()));
+      out.write<double>(numericValue(values[price], attrs[price].getType()));
+      out.write<double>(numericValue(values[size], attrs[size].getType()));
+      out.write<char>(toupper(values[action].getString()[0]));
+      char s = values[side].isNull() ? 0 : toupper(values[side].getString()[0]);
+      out.write<char>(s == 'A' ? 'S' : s);
+    });
+  }
+
+  static void receiveMessages(vector<CellReader>& incoming, vector<Message>& messages)
+  {
+    for(size_t i = 0; i < incoming.size(); ++i)
+    {
+      CellReader& in = incoming[i];
+      while(!in.end())
+      {
+        messages.push_back(Message());
+        Message& m = messages.back();
+        m.key    = in.read<int64_t>();
+        m.time   = in.read<int64_t>();
+        in.readCoordinates(m.pos);
+        m.order  = in.read<int64_t>();
+        m.price  = in.read<double>();
+        m.size   = in.read<double>();
+        m.action = in.read<char>();
+        m.side   = in.read<char>();
+      }
+    }
+  }
+
+/* Replay the messages order[begin, end) of one symbol, appending the
+ * snapshots that are due to cells.
+ */
+  static void replaySymbol(vector<Message const*> const& order, size_t begin, size_t end,
+                           uint32_t depth, int64_t interval, double tick,
+                           vector<OutputCell>& cells, vector<char>& buf)
+  {
+    ReplayBook book(tick);
+    for(size_t j = begin; j < end; ++j)
+    {
+      Message const& m = *order[j];
+      book.apply(m);
+      if(interval > 0 && j + 1 < end &&
+         floorDiv(order[j + 1]->time, interval) == floorDiv(m.time, interval)) continue;
+      cells.push_back(OutputCell());
+      cells.back().pos = m.pos;
+      cells.back().values.resize(1);
+      book.snapshot(depth, buf, cells.back().values[0]);
+    }
+  }
+
+public:
+  PhysicalBookReplay(string const& logicalName, string const& physicalName,
+                     Parameters const& parameters, ArrayDesc const& schema):
+    PhysicalOperator(logicalName, physicalName, parameters, schema)
+  {}
+
+  virtual bool changesDistribution(vector<ArrayDesc> const&) const
+  {
+    return true;
+  }
+
+  virtual RedistributeContext getOutputDistribution(vector<RedistributeContext> const&,
+                                                    vector<ArrayDesc> const&) const
+  {
+    return RedistributeContext(psHashPartitioned);
+  }
+
+  std::shared_ptr<Array> execute(vector< std::shared_ptr<Array> >& inputArrays, std::shared_ptr<Query> query)
+  {
+    string keyDim  = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()->evaluate().getString();
+    string timeDim = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[1])->getExpression()->evaluate().getString();
+    int64_t depth  = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[2])->getExpression()->evaluate().getInt64();
+    int64_t interval = 0;
+    double tick = BOOK_DEFAULT_TICK;
+    if(_parameters.size() > 3)
+    {
+      interval = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[3])->getExpression()->evaluate().getInt64();
+    }
+    if(_parameters.size() > 4)
+    {
+      tick = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[4])->getExpression()->evaluate().getDouble();
+    }
+    if(depth > (int64_t) BOOK_UNLIMITED_DEPTH) depth = BOOK_UNLIMITED_DEPTH;
+
+    vector<Message> messages;
+    {
+      vector<CellWriter> outgoing(query->getInstancesCount());
+      shipMessages(inputArrays[0], keyDim, timeDim, outgoing);
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      receiveMessages(incoming, messages);
+    }
+    vector<Message const*> order(messages.size());
+    for(size_t j = 0; j < messages.size(); ++j) order[j] = &messages[j];
+    sort(order.begin(), order.end(), MessageOrder());
+
+/* The symbols of a row of chunks along the symbol dimension write only
+ * to those chunks. rows holds where the messages of each row start, and
+ * the symbols within a row start where the symbol changes.
+ */
+    DimensionDesc const& keyDesc = _schema.getDimensions()[dimensionIndex(_schema, keyDim)];
+    int64_t const keyStart = keyDesc.getStartMin();
+    int64_t const keyChunk = keyDesc.getChunkInterval();
+    vector<size_t> rows;
+    for(size_t j = 0; j < order.size(); ++j)
+    {
+      if(j == 0 || floorDiv(order[j]->key - keyStart, keyChunk) != floorDiv(order[j - 1]->key - keyStart, keyChunk))
+      {
+        rows.push_back(j);
+      }
+    }
+    rows.push_back(order.size());
+
+    size_t const nRows = rows.size() - 1;
+    size_t const nThreads = min<size_t>(min(BOOK_REPLAY_THREADS, max(1u, thread::hardware_concurrency())), nRows);
+    std::shared_ptr<MemArray> output(new MemArray(_schema, query));
+    vector< vector<OutputCell> > cells(nThreads);
+    for(size_t r0 = 0; r0 < nRows; r0 += nThreads)
+    {
+      size_t const batch = min(nThreads, nRows - r0);
+      atomic<size_t> next(0);
+      auto worker = [&]()
+      {
+        vector<char> buf;
+        for(size_t i = next++; i < batch; i = next++)
+        {
+          for(size_t begin = rows[r0 + i], end; begin < rows[r0 + i + 1]; begin = end)
+          {
+            for(end = begin + 1; end < rows[r0 + i + 1] && order[end]->key == order[begin]->key; ++end);
+            replaySymbol(order, begin, end, depth, interval, tick, cells[i], buf);
+          }
+        }
+      };
+      vector<thread> threads;
+      for(size_t i = 1; i < batch; ++i) threads.push_back(thread(worker));
+      worker();
+      for(size_t i = 0; i < threads.size(); ++i) threads[i].join();
+      for(size_t i = 0; i < batch; ++i)
+      {
+        writeCells(output, cells[i], query);
+        cells[i].clear();
+      }
+    }
+    order.clear();
+    messages.clear();
+
+    std::shared_ptr<Array> result = output;
+    return redistributeOutput(result, query);
+  }
+};
+
+REGISTER_PHYSICAL_OPERATOR_FACTORY(PhysicalBookReplay, "book_replay", "PhysicalBookReplay");
@@ -0,0 +1,277 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "query/Operator.h"
+#include "array/MemArray.h"
+
+#include "InstanceExchange.h"
+#include "R/fun.h"
+
+using namespace std;
+using namespace scidb;
+using namespace superfunpack;
+
+/* Consecutive overlaps of a group at most this far apart are reached by
+ * adding up the densities in between; farther ones start a new phyper tail.
+ */
+#define ENRICHMENT_WALK 256
+
+/* The enrichment test runs in three steps:
+ *
+ * 1. Every instance reads its local cells and ships each test to the
+ *    instance owning its family, the tests of one list, picked by a hash of
+ *    its list dimension coordinate.
+ * 2. Each instance sorts its tests by family, then by list size k, universe
+ *    N, set size m and overlap x, from the largest overlap down. The tests
+ *    of one family and (m, N - m, k), a group, then take a single walk down
+ *    the upper tail of their common distribution: the largest overlap
+ *    starts a phyper tail, and each next one adds the densities between it
+ *    and the one before. The p-values of each family are then sorted and
+ *    adjusted as R's p.adjust(p, "BH").
+ * 3. The p-values and adjusted values go back to the instances the tests
+ *    came from, which write them next to the input attributes.
+ */
+class PhysicalEnrichment : public PhysicalOperator
+{
+/* A test at the instance that owns its family, with the instance and
+ * local index it came from
+ */
+  struct Test
+  {
+    int64_t list;
+    double k, N, m, x;
+    uint32_t from;
+    uint64_t index;
+    double p, adjusted;
+
+/* By family, then group, then overlap from the largest down */
+    bool operator<(Test const& t) const
+    {
+      if(list != t.list) return list < t.list;
+      if(k != t.k) return k < t.k;
+      if(N != t.N) return N < t.N;
+      if(m != t.m) return m < t.m;
+      return x > t.x;
+    }
+  };
+
+  static bool pLess(Test const* a, Test const* b)
+  {
+    return a->p < b->p;
+  }
+
+  static size_t attributeIndex(ArrayDesc const& schema, string const& name)
+  {
+    Attributes const& attrs = schema.getAttributes(true);
+    for(size_t a = 0; a < attrs.size(); ++a)
+    {
+      if(attrs[a].getName() == name) return a;
+    }
+    return attrs.size();
+  }
+
+  static size_t dimensionIndex(ArrayDesc const& schema, string const& name)
+  {
+    Dimensions const& dims = schema.getDimensions();
+    for(size_t d = 0; d < dims.size(); ++d)
+    {
+      if(dims[d].hasNameAndAlias(name)) return d;
+    }
+    return dims.size();
+  }
+
+/* Whether x, m, k and N are whole numbers that make a table */
+  static bool isTable(double x, double m, double k, double N)
+  {
+    if(!(isfinite(x) && isfinite(m) && isfinite(k) && isfinite(N))) return false;
+    if(x != floor(x) || m != floor(m) || k != floor(k) || N != floor(N)) return false;
+    if(m < 0 || k < 0 || m > N || k > N) return false;
+    return x >= max(0.0, k - (N - m)) && x <= min(m, k);
+  }
+
+/* The upper tails P(X >= x) of one group, sorted from the largest x down */
+  static void group(Test *t, size_t n)
+  {
+    double m = t[0].m, b = t[0].N - t[0].m, k = t[0].k;
+    double at = NAN, tail = NAN;    // tail = P(X >= at)
+    for(size_t j = 0; j < n; ++j)
+    {
+      if(t[j].x != at)
+      {
+        if(!isnan(at) && at - t[j].x <= ENRICHMENT_WALK)
+        {
+          for(double y = at - 1; y >= t[j].x; --y) tail += dhyper(y, m, b, k, 0);
+        }
+        else tail = phyper(t[j].x - 1, m, b, k, 0, 0);
+        at = t[j].x;
+      }
+      t[j].p = min(1.0, tail);
+    }
+  }
+
+/* R's p.adjust(p, "BH") over one family */
+  static void family(Test *t, size_t n, vector<Test*>& order)
+  {
+    order.resize(n);
+    for(size_t j = 0; j < n; ++j) order[j] = t + j;
+    sort(order.begin(), order.end(), pLess);
+    double running = INFINITY;
+    for(size_t r = n; r-- > 0; )
+    {
+      running = min(running, (double) n / (double) (r + 1) * order[r]->p);
+      order[r]->adjusted = min(1.0, running);
+    }
+  }
+
+public:
+  PhysicalEnrichment(string const& logicalName, string const& physicalName,
+                     Parameters const& parameters, ArrayDesc const& schema):
+    PhysicalOperator(logicalName, physicalName, parameters, schema)
+  {}
+
+  virtual bool changesDistribution(vector<ArrayDesc> const&) const
+  {
+    return true;
+  }
+
+  virtual RedistributeContext getOutputDistribution(vector<RedistributeContext> const&,
+                                                    vector<ArrayDesc> const&) const
+  {
+    return RedistributeContext(psHashPartitioned);
+  }
+
+  std::shared_ptr<Array> execute(vector< std::shared_ptr<Array> >& inputArrays, std::shared_ptr<Query> query)
+  {
+    size_t const nInstances = query->getInstancesCount();
+    ArrayDesc const& schema = inputArrays[0]->getArrayDesc();
+    Attributes const& attrs = schema.getAttributes(true);
+    size_t const nAttrs = attrs.size();
+    size_t col[4];     // x, m, k, N
+    TypeId type[4];
+    for(size_t j = 0; j < 4; ++j)
+    {
+      col[j] = attributeIndex(schema, ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[j])->getExpression()->evaluate().getString());
+      type[j] = attrs[col[j]].getType();
+    }
+    size_t const list = dimensionIndex(schema, ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[4])->getExpression()->evaluate().getString());
+
+/* The local cells, with null or NaN results filled in already, and the
+ * tests bound for each instance
+ */
+    vector<OutputCell> cells;
+    vector<CellWriter> outgoing(nInstances);
+    scanCells(inputArrays[0], [&](Coordinates const& pos, vector<Value> const& values)
+    {
+      cells.push_back(OutputCell());
+      OutputCell& cell = cells.back();
+      cell.pos = pos;
+      cell.values = values;
+      cell.values.resize(nAttrs + 2);
+      double v[4];
+      for(size_t j = 0; j < 4; ++j)
+      {
+        if(values[col[j]].isNull())
+        {
+          cell.values[nAttrs].setNull(0);
+          cell.values[nAttrs + 1].setNull(0);
+          return;
+        }
+        v[j] = numericValue(values[col[j]], type[j]);
+      }
+      if(!isTable(v[0], v[1], v[2], v[3]))
+      {
+        cell.values[nAttrs].setDouble(NAN);
+        cell.values[nAttrs + 1].setDouble(NAN);
+        return;
+      }
+      CellWriter& out = outgoing[instanceForKey(pos[list], nInstances)];
+      out.write<int64_t>(pos[list]);
+      out.write<double>(v[0]);
+      out.write<double>(v[1]);
+      out.write<double>(v[2]);
+      out.write<double>(v[3]);
+      out.write<uint64_t>(cells.size() - 1);
+    });
+
+    vector<Test> tests;
+    {
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      outgoing.clear();
+      for(size_t i = 0; i < incoming.size(); ++i)
+      {
+        while(!incoming[i].end())
+        {
+          Test t;
+          t.list = incoming[i].read<int64_t>();
+          t.x = incoming[i].read<double>();
+          t.m = incoming[i].read<double>();
+          t.k = incoming[i].read<double>();
+          t.N = incoming[i].read<double>();
+          t.from = i;
+          t.index = incoming[i].read<uint64_t>();
+          tests.push_back(t);
+        }
+      }
+    }
+    sort(tests.begin(), tests.end());
+
+    vector<Test*> order;
+    for(size_t f0 = 0, f1; f0 < tests.size(); f0 = f1)
+    {
+      for(f1 = f0 + 1; f1 < tests.size() && tests[f1].list == tests[f0].list; ++f1);
+      for(size_t g0 = f0, g1; g0 < f1; g0 = g1)
+      {
+        for(g1 = g0 + 1; g1 < f1 && tests[g1].k == tests[g0].k && tests[g1].N == tests[g0].N
+                         && tests[g1].m == tests[g0].m; ++g1);
+        group(&tests[g0], g1 - g0);
+      }
+      family(&tests[f0], f1 - f0, order);
+    }
+
+    {
+      vector<CellWriter> outgoing(nInstances);
+      for(size_t j = 0; j < tests.size(); ++j)
+      {
+        outgoing[tests[j].from].write<uint64_t>(tests[j].index);
+        outgoing[tests[j].from].write<double>(tests[j].p);
+        outgoing[tests[j].from].write<double>(tests[j].adjusted);
+      }
+      tests.clear();
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      for(size_t i = 0; i < incoming.size(); ++i)
+      {
+        while(!incoming[i].end())
+        {
+          uint64_t index = incoming[i].read<uint64_t>();
+          cells[index].values[nAttrs].setDouble(incoming[i].read<double>());
+          cells[index].values[nAttrs + 1].setDouble(incoming[i].read<double>());
+        }
+      }
+    }
+
+    std::shared_ptr<Array> output = writeCells(_schema, cells, query);
+    return redistributeOutput(output, query);
+  }
+};
+
+REGISTER_PHYSICAL_OPERATOR_FACTORY(PhysicalEnrichment, "enrichment", "PhysicalEnrichment");
@@ -0,0 +1,365 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <math.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "query/Operator.h"
+#include "array/MemArray.h"
+
+#include "InstanceExchange.h"
+
+using namespace std;
+using namespace scidb;
+using namespace superfunpack;
+
+/* The p-values are ranked with a histogram partitioned sort: the order
+ * preserving top bits of each p-value pick one of P_ADJUST_BINS bins. */
+#define P_ADJUST_BIN_BITS 16
+#define P_ADJUST_BINS     (1 << P_ADJUST_BIN_BITS)
+
+/* The multiple-testing adjustment runs in five steps:
+ *
+ * 1. Every instance reads its local cells and histograms their p-values,
+ *    with the smallest and largest p-value of each bin. The histograms are
+ *    summed on every instance, which then knows the number of tests n, how
+ *    many p-values fall in each bin, and which bins hold a single value.
+ * 2. The global ranks are split into ranges of about n / instances, one
+ *    range per instance, and every p-value is shipped to the instance owning
+ *    its rank. A bin of distinct p-values goes whole to the instance owning
+ *    its first rank. A bin of ties, like the many p-values of exactly 1, is
+ *    ordered by source instance and local index, so each source knows the
+ *    ranks of its own ties from the counts of the sources before it, and
+ *    the bin is split across consecutive instances. Instance i then holds
+ *    the p-values of global ranks first[i] + 1 ... first[i + 1].
+ * 3. Each instance sorts its p-values and computes the raw adjusted values
+ *    from their global ranks.
+ * 4. The step-up methods take a cumulative minimum from the largest p-value
+ *    down, the step-down methods a cumulative maximum from the smallest up.
+ *    Each instance shares the minimum (or maximum) of its range, so that
+ *    the cumulative pass continues across instances.
+ * 5. The adjusted values go back to the instances the p-values came from,
+ *    which write them in place of the p-values.
+ */
+class PhysicalPAdjust : public PhysicalOperator
+{
+  enum Method
+  {
+    BONFERRONI,
+    HOLM,
+    HOCHBERG,
+    BH,
+    BY,
+    NONE
+  };
+
+/* A p-value at the instance that ranks it, with the instance and local
+ * index it came from.
+ */
+  struct Rank
+  {
+    double p;
+    uint32_t from;
+    uint64_t index;
+
+    bool operator<(Rank const& r) const
+    {
+      if(p != r.p) return p < r.p;
+      if(from != r.from) return from < r.from;
+      return index < r.index;
+    }
+  };
+
+  static Method parseMethod(string const& method)
+  {
+    if(strcasecmp(method.c_str(), "bonferroni") == 0) return BONFERRONI;
+    if(strcasecmp(method.c_str(), "holm") == 0)       return HOLM;
+    if(strcasecmp(method.c_str(), "hochberg") == 0)   return HOCHBERG;
+    if(strcasecmp(method.c_str(), "BH") == 0 ||
+       strcasecmp(method.c_str(), "fdr") == 0)        return BH;
+    if(strcasecmp(method.c_str(), "BY") == 0)         return BY;
+    return NONE;
+  }
+
+  static size_t attributeIndex(ArrayDesc const& schema, string const& name)
+  {
+    Attributes const& attrs = schema.getAttributes(true);
+    for(size_t a = 0; a < attrs.size(); ++a)
+    {
+      if(attrs[a].getName() == name) return a;
+    }
+    return attrs.size();
+  }
+
+/* The bin of a p-value. Flipping the sign bit of positive doubles and all
+ * the bits of negative ones makes their bit patterns sort like the values.
+ */
+  static uint32_t binOf(double p)
+  {
+    uint64_t u;
+    memcpy(&u, &p, sizeof(u));
+    u = (u >> 63) ? ~u : u | 0x8000000000000000ULL;
+    return u >> (64 - P_ADJUST_BIN_BITS);
+  }
+
+/* Send the same double to every instance and return what each one sent */
+  static vector<double> shareDouble(double v, std::shared_ptr<Query>& query)
+  {
+    vector<CellWriter> outgoing(query->getInstancesCount());
+    for(size_t i = 0; i < outgoing.size(); ++i) outgoing[i].write<double>(v);
+    vector<CellReader> incoming = exchangeCells(outgoing, query);
+    vector<double> res(incoming.size());
+    for(size_t i = 0; i < incoming.size(); ++i) res[i] = incoming[i].read<double>();
+    return res;
+  }
+
+/* The adjusted value of the p-value of global rank i (from 1) out of n,
+ * before the cumulative pass, computed in the same order as R's p.adjust.
+ */
+  static double scale(Method method, double p, double i, double n, double q)
+  {
+    switch(method)
+    {
+      case BONFERRONI: return n * p;
+      case HOLM:       return (n - i + 1) * p;
+      case HOCHBERG:   return (n + 1 - i) * p;
+      case BH:         return n / i * p;
+      case BY:         return q * n / i * p;
+      default:         return p;
+    }
+  }
+
+public:
+  PhysicalPAdjust(string const& logicalName, string const& physicalName,
+                  Parameters const& parameters, ArrayDesc const& schema):
+    PhysicalOperator(logicalName, physicalName, parameters, schema)
+  {}
+
+  virtual bool changesDistribution(vector<ArrayDesc> const&) const
+  {
+    return true;
+  }
+
+  virtual RedistributeContext getOutputDistribution(vector<RedistributeContext> const&,
+                                                    vector<ArrayDesc> const&) const
+  {
+    return RedistributeContext(psHashPartitioned);
+  }
+
+  std::shared_ptr<Array> execute(vector< std::shared_ptr<Array> >& inputArrays, std::shared_ptr<Query> query)
+  {
+    string attr   = ((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()->evaluate().getString();
+    Method method = parseMethod(((std::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[1])->getExpression()->evaluate().getString());
+    size_t const nInstances = query->getInstancesCount();
+    InstanceID const myId = query->getInstanceID();
+    ArrayDesc const& schema = inputArrays[0]->getArrayDesc();
+    size_t const pa = attributeIndex(schema, attr);
+    TypeId const ptype = schema.getAttributes(true)[pa].getType();
+
+/* The local cells, with their p-values already converted to doubles, and
+ * the indexes of the cells that count as tests.
+ */
+    vector<OutputCell> cells;
+    vector<uint64_t> tests;
+    vector<uint64_t> hist(P_ADJUST_BINS, 0);
+    vector<double> lo(P_ADJUST_BINS, INFINITY);
+    vector<double> hi(P_ADJUST_BINS, -INFINITY);
+    scanCells(inputArrays[0], [&](Coordinates const& pos, vector<Value> const& values)
+    {
+      cells.push_back(OutputCell());
+      OutputCell& cell = cells.back();
+      cell.pos = pos;
+      cell.values = values;
+      if(values[pa].isNull()) return;
+      double p = numericValue(values[pa], ptype);
+      cell.values[pa].setDouble(p);
+      if(isnan(p)) return;
+      tests.push_back(cells.size() - 1);
+      uint32_t b = binOf(p);
+      hist[b]++;
+      lo[b] = min(lo[b], p);
+      hi[b] = max(hi[b], p);
+    });
+
+/* before[b] counts the p-values of bin b on the instances before this one */
+    vector<uint64_t> before(P_ADJUST_BINS, 0);
+
+    {
+      vector<CellWriter> outgoing(nInstances);
+      for(size_t i = 0; i < nInstances; ++i)
+      {
+        for(uint32_t b = 0; b < P_ADJUST_BINS; ++b)
+        {
+          if(hist[b] == 0) continue;
+          outgoing[i].write<uint32_t>(b);
+          outgoing[i].write<uint64_t>(hist[b]);
+          outgoing[i].write<double>(lo[b]);
+          outgoing[i].write<double>(hi[b]);
+        }
+      }
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      fill(hist.begin(), hist.end(), 0);
+      for(size_t i = 0; i < incoming.size(); ++i)
+      {
+        while(!incoming[i].end())
+        {
+          uint32_t b = incoming[i].read<uint32_t>();
+          uint64_t count = incoming[i].read<uint64_t>();
+          hist[b] += count;
+          if(i < myId) before[b] += count;
+          lo[b] = min(lo[b], incoming[i].read<double>());
+          hi[b] = max(hi[b], incoming[i].read<double>());
+        }
+      }
+    }
+    uint64_t n = 0;
+    for(uint32_t b = 0; b < P_ADJUST_BINS; ++b) n += hist[b];
+
+/* Cut the ranks into ranges of about equal counts. The rank from 0 of the
+ * first p-value of each bin is start[b], and a bin of distinct values goes
+ * to the owner of its start, so only heavy bins of distinct values may
+ * leave an instance with more than its share.
+ */
+    auto rankOwner = [&](uint64_t g) -> size_t
+    {
+      return n == 0 ? 0 : min<uint64_t>(nInstances - 1, (g * nInstances) / n);
+    };
+    vector<uint64_t> start(P_ADJUST_BINS);
+    vector<uint64_t> first(nInstances + 1, 0);
+    uint64_t below = 0;
+    for(uint32_t b = 0; b < P_ADJUST_BINS; ++b)
+    {
+      start[b] = below;
+      below += hist[b];
+      if(hist[b] == 0) continue;
+      if(lo[b] != hi[b])
+      {
+        first[rankOwner(start[b]) + 1] += hist[b];
+        continue;
+      }
+      for(uint64_t g = start[b]; g < below; )
+      {
+        size_t i = rankOwner(g);
+        uint64_t end = i + 1 == nInstances ? below : min(below, ((i + 1) * n + nInstances - 1) / nInstances);
+        first[i + 1] += end - g;
+        g = end;
+      }
+    }
+    for(size_t i = 0; i < nInstances; ++i) first[i + 1] += first[i];
+
+    vector<Rank> ranks;
+    {
+      vector<CellWriter> outgoing(nInstances);
+      for(size_t j = 0; j < tests.size(); ++j)
+      {
+        double p = cells[tests[j]].values[pa].getDouble();
+        uint32_t b = binOf(p);
+        size_t const to = lo[b] != hi[b] ? rankOwner(start[b]) : rankOwner(start[b] + before[b]++);
+        CellWriter& out = outgoing[to];
+        out.write<double>(p);
+        out.write<uint64_t>(tests[j]);
+      }
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      for(size_t i = 0; i < incoming.size(); ++i)
+      {
+        while(!incoming[i].end())
+        {
+          Rank r;
+          r.p = incoming[i].read<double>();
+          r.from = i;
+          r.index = incoming[i].read<uint64_t>();
+          ranks.push_back(r);
+        }
+      }
+    }
+    sort(ranks.begin(), ranks.end());
+
+/* The BY constant, summed in long double like R's sum */
+    double q = 0;
+    if(method == BY)
+    {
+      long double s = 0;
+      for(uint64_t l = 1; l <= n; ++l) s += 1.0 / (double) l;
+      q = (double) s;
+    }
+    vector<double> adjusted(ranks.size());
+    for(size_t r = 0; r < ranks.size(); ++r)
+    {
+      adjusted[r] = scale(method, ranks[r].p, (double) (first[myId] + r + 1), (double) n, q);
+    }
+
+    bool stepUp   = method == HOCHBERG || method == BH || method == BY;
+    bool stepDown = method == HOLM;
+    double local = stepUp ? INFINITY : -INFINITY;
+    for(size_t r = 0; r < adjusted.size(); ++r)
+    {
+      local = stepUp ? min(local, adjusted[r]) : max(local, adjusted[r]);
+    }
+    vector<double> bounds = shareDouble(local, query);
+    if(stepUp)
+    {
+      double running = INFINITY;
+      for(size_t i = myId + 1; i < nInstances; ++i) running = min(running, bounds[i]);
+      for(size_t r = adjusted.size(); r-- > 0; )
+      {
+        running = min(running, adjusted[r]);
+        adjusted[r] = running;
+      }
+    } else if(stepDown)
+    {
+      double running = -INFINITY;
+      for(size_t i = 0; i < myId; ++i) running = max(running, bounds[i]);
+      for(size_t r = 0; r < adjusted.size(); ++r)
+      {
+        running = max(running, adjusted[r]);
+        adjusted[r] = running;
+      }
+    }
+    if(method != NONE)
+    {
+      for(size_t r = 0; r < adjusted.size(); ++r) adjusted[r] = min(1.0, adjusted[r]);
+    }
+
+    {
+      vector<CellWriter> outgoing(nInstances);
+      for(size_t r = 0; r < ranks.size(); ++r)
+      {
+        outgoing[ranks[r].from].write<uint64_t>(ranks[r].index);
+        outgoing[ranks[r].from].write<double>(adjusted[r]);
+      }
+      ranks.clear();
+      vector<CellReader> incoming = exchangeCells(outgoing, query);
+      for(size_t i = 0; i < incoming.size(); ++i)
+      {
+        while(!incoming[i].end())
+        {
+          uint64_t index = incoming[i].read<uint64_t>();
+          cells[index].values[pa].setDouble(incoming[i].read<double>());
+        }
+      }
+    }
+
+    std::shared_ptr<Array> output = writeCells(_schema, cells, query);
+    return redistributeOutput(output, query);
+  }
+};
+
+REGISTER_PHYSICAL_OPERATOR_FACTORY(PhysicalPAdjust, "p_adjust", "PhysicalPAdjust");
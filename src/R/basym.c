@@ -0,0 +1,195 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  DESCRIPTION
+ *
+ *    The asymptotic expansion of the incomplete beta function for large a
+ *    and b, basym from Algorithm 708 of DiDonato and Morris (ACM TOMS 18,
+ *    1992), which R's pbeta uses near the mean of the distribution, with
+ *    the two helpers it shares with the incomplete gamma expansion in
+ *    ppois.c. The cost does not grow with a and b.
+ */
+
+#include <float.h>
+#include <math.h>
+#include "fun.h"
+
+/* basym sums at most this many pairs of terms, an even number */
+#define BASYM_TERMS 20
+
+/*
+ * rlog1(x) = x - log(1 + x), for x > -1, without cancellation for small x:
+ * with u = x / (2 + x), log(1 + x) = 2 (u + u^3/3 + u^5/5 + ...) and
+ * x - 2u = u x.
+ */
+double
+rlog1 (double x)
+{
+  double u, u2, term, sum;
+  int j;
+
+  if (fabs (x) > 0.5)
+    return x - log1p (x);
+  u = x / (2 + x);
+  u2 = u * u;
+  term = u;
+  sum = 0;
+  for (j = 3; j < 100; j += 2)
+    {
+      term *= u2;
+      if (fabs (term) < DBL_EPSILON * 0.25 * fabs (u * x))
+        break;
+      sum += term / j;
+    }
+  return u * x - 2 * sum;
+}
+
+/*
+ * erfcx(x) = exp(x^2) erfc(x), for x >= 0. The square is split into its
+ * rounded value and the rounding error, so that exp(x^2) keeps its
+ * relative accuracy, and large x use the asymptotic series.
+ */
+double
+erfcx (double x)
+{
+  double x2, lo, term, sum;
+  int j;
+
+  if (x < 25)
+    {
+      x2 = x * x;
+      lo = fma (x, x, -x2);
+      return exp (x2) * (1 + lo) * erfc (x);
+    }
+  x2 = 2 * x * x;
+  term = 1;
+  sum = 1;
+  for (j = 1; j < 20; j++)
+    {
+      term *= -(2 * j - 1) / x2;
+      sum += term;
+    }
+  return sum * 0.56418958354775628695 / x;     /* 1/sqrt(pi) */
+}
+
+/*
+ * bcorr(a, b) = del(a) + del(b) - del(a + b), where
+ * log Gamma(a) = (a - 1/2) log a - a + log(2 pi)/2 + del(a), so that del
+ * is stirlerr.
+ */
+static double
+bcorr (double a, double b)
+{
+  return stirlerr (a) + stirlerr (b) - stirlerr (a + b);
+}
+
+/*
+ * The incomplete beta function I_x(a, b) for a, b >= 15, where
+ * lambda = a - (a + b) x >= 0, so x is at most the mean a / (a + b) and
+ * this is the lower tail. eps is the relative tolerance of the sum.
+ */
+double
+basym (double a, double b, double lambda, double eps)
+{
+  static const double e0 = 1.12837916709551257390;     /* 2/sqrt(pi) */
+  static const double e1 = 0.35355339059327376220;     /* 2^(-3/2) */
+  double a0[BASYM_TERMS + 1], b0[BASYM_TERMS + 1], c[BASYM_TERMS + 1],
+    d[BASYM_TERMS + 1];
+  double f, t, z0, z, z2, h, r0, r1, w0, j0, j1, sum, s, h2, hn, w,
+    znm1, zn, r, bsum, dsum, t0, t1;
+  int n, np1, i, m, j;
+
+  f = a * rlog1 (-lambda / a) + b * rlog1 (lambda / b);
+  t = exp (-f);
+  if (t == 0)
+    return 0;
+  z0 = sqrt (f);
+  z = z0 / e1 * 0.5;
+  z2 = f + f;
+
+  if (a < b)
+    {
+      h = a / b;
+      r0 = 1 / (h + 1);
+      r1 = (b - a) / b;
+      w0 = 1 / sqrt (a * (h + 1));
+    }
+  else
+    {
+      h = b / a;
+      r0 = 1 / (h + 1);
+      r1 = (b - a) / a;
+      w0 = 1 / sqrt (b * (h + 1));
+    }
+
+  a0[0] = r1 * 2 / 3;
+  c[0] = -a0[0] / 2;
+  d[0] = -c[0];
+  j0 = 0.5 / e0 * erfcx (z0);
+  j1 = e1;
+  sum = j0 + d[0] * w0 * j1;
+
+  s = 1;
+  h2 = h * h;
+  hn = 1;
+  w = w0;
+  znm1 = z;
+  zn = z2;
+  for (n = 2; n <= BASYM_TERMS; n += 2)
+    {
+      hn *= h2;
+      a0[n - 1] = r0 * 2 * (h * hn + 1) / (n + 2);
+      np1 = n + 1;
+      s += hn;
+      a0[np1 - 1] = r1 * 2 * s / (n + 3);
+
+      for (i = n; i <= np1; i++)
+        {
+          r = (i + 1) * -0.5;
+          b0[0] = r * a0[0];
+          for (m = 2; m <= i; m++)
+            {
+              bsum = 0;
+              for (j = 1; j <= m - 1; j++)
+                bsum += (j * r - (m - j)) * a0[j - 1] * b0[m - j - 1];
+              b0[m - 1] = r * a0[m - 1] + bsum / m;
+            }
+          c[i - 1] = b0[i - 1] / (i + 1);
+
+          dsum = 0;
+          for (j = 1; j <= i - 1; j++)
+            dsum += d[i - j - 1] * c[j - 1];
+          d[i - 1] = -(dsum + c[i - 1]);
+        }
+
+      j0 = e1 * znm1 + (n - 1) * j0;
+      j1 = e1 * zn + n * j1;
+      znm1 *= z2;
+      zn *= z2;
+      w *= w0;
+      t0 = d[n - 1] * w * j0;
+      w *= w0;
+      t1 = d[np1 - 1] * w * j1;
+      sum += t0 + t1;
+      if (fabs (t0) + fabs (t1) <= eps * sum)
+        break;
+    }
+
+  return e0 * t * exp (-bcorr (a, b)) * sum;
+}
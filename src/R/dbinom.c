@@ -82,3 +82,21 @@ dbinom_raw (double x, double n, double p, double q, int give_log)
 
   return R_D_exp (lc - 0.5 * lf);
 }
+
+double
+dbinom (double x, double n, double p, int give_log)
+{
+  if (isnan (x) || isnan (n) || isnan (p))
+    return x + n + p;
+
+  if (p < 0 || p > 1 || R_D_negInonint (n))
+    return NAN;
+  R_D_nonint_check (x);
+  if (x < 0 || !isfinite (x))
+    return R_D__0;
+
+  n = round (n);
+  x = round (x);
+
+  return dbinom_raw (x, n, p, 1 - p, give_log);
+}
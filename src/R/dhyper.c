@@ -43,9 +43,6 @@
 #include "dpq.h"
 #include "fun.h"
 
-#define R_nonint(x)      (fabs((x) - round(x)) > 1e-7*fmax2(1., fabs(x)))
-#define R_D_negInonint(x) (x < 0. || R_nonint(x))
-
 double
 fmax2(double x, double y)
 {
@@ -78,6 +75,14 @@ dhyper (double x, double r, double b, double n, int give_log)
   if (n == 0)
     return ((x == 0) ? R_D__1 : R_D__0);
 
+  /* Integer counts within the log-factorial table take nine lookups */
+  if (r + b <= LFACT_MAX)
+    {
+      const double *t = lfact_table (r + b);
+      if (t)
+        return R_D_exp (lfact_ldhyper (t, x, r, b, n));
+    }
+
   p = ((double) n) / ((double) (r + b));
   q = ((double) (r + b - n)) / ((double) (r + b));
 
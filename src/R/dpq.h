@@ -116,6 +116,9 @@
 /* additions for density functions (C.Loader) */
 #define R_D_fexp(f,x)     (give_log ? -0.5*log(f)+(x) : exp(x)/sqrt(f))
 
+/* [non int]eger, up to a relative fuzz : */
+#define R_nonint(x) 	  (fabs((x) - round(x)) > 1e-7*fmax2(1., fabs(x)))
+
 /* [neg]ative or [non int]eger : */
 #define R_D_negInonint(x) (x < 0. || R_nonint(x))
 
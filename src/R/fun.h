@@ -1,7 +1,14 @@
 
+#define M_2PI          6.283185307179586476925286766559 /* 2*pi */
 #define M_LN_2PI       1.837877066409345483560659472811      /* log(2*pi) */
 #define M_LN_SQRT_2PI  0.918938533204672741780329736406 /* log(sqrt(2*pi))*/
 #define M_LN_SQRT_PId2 0.225791352644727432363097614947 /* log(sqrt(pi/2))*/
+#ifndef M_LN2
+#define M_LN2          0.693147180559945309417232121458 /* ln(2) */
+#endif
+
+/* The largest n of the log-factorial table */
+#define LFACT_MAX 1048576
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,9 +27,48 @@ dbinom_raw (double x, double n, double p, double q, int give_log);
 double
 fmax2(double x, double y);
 
+double
+dbinom (double x, double n, double p, int give_log);
+
+double
+pbinom (double x, double n, double p, int lower_tail, int log_p);
+
+double
+qbinom (double p, double n, double pr, int lower_tail, int log_p);
+
+double
+dpois_raw (double x, double lambda, int give_log);
+
+double
+dpois (double x, double lambda, int give_log);
+
+double
+ppois (double x, double lambda, int lower_tail, int log_p);
+
+double
+rlog1 (double x);
+
+double
+erfcx (double x);
+
+double
+basym (double a, double b, double lambda, double eps);
+
 double
 dhyper (double x, double r, double b, double n, int give_log);
 
+double
+phyper (double x, double NR, double NB, double n, int lower_tail, int log_p);
+
+double
+qhyper (double p, double NR, double NB, double n, int lower_tail, int log_p);
+
+const double *
+lfact_table (int n);
+
+double
+lfact_ldhyper (const double *t, int x, int r, int b, int n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,182 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  DESCRIPTION
+ *
+ *    A process-wide table of log(n!) for the integers 0 <= n <= LFACT_MAX,
+ *    built on demand up to the largest n asked for so far, in blocks of
+ *    LFACT_BLOCK entries, and read-only once built. Space for the whole
+ *    table, 16 MB, is reserved on first use, but only the pages of the
+ *    entries built are touched.
+ *
+ *    A log density of counts is a sum of log factorials of order n log n
+ *    that mostly cancel, so each entry is kept in double-double precision
+ *    (an unevaluated sum hi + lo, about 32 significant digits). That leaves
+ *    sums of up to a few dozen entries accurate to the last bit of a double.
+ *
+ *    The entries are accumulated upward from
+ *
+ *	log(n) = log(n-1) + log(n/(n-1)) = log(n-1) + 2 atanh(1/(2n-1))
+ *
+ *    with the atanh series summed in double-double. The series converges
+ *    like (2n-1)^-2, so past the first few entries it takes two or three
+ *    terms, and the rounding of the whole accumulation stays below 1e-19
+ *    absolute at n = LFACT_MAX.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "fun.h"
+
+/* The entries built at a time */
+#define LFACT_BLOCK 4096
+
+static double *lfact;		/* hi, lo pairs, NULL when unavailable */
+static int lfact_built = -1;	/* the entries through this n are built */
+static double lfact_lh, lfact_ll;	/* log(lfact_built), when >= 2 */
+static pthread_mutex_t lfact_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Double-double arithmetic, after Dekker and Knuth. The sums are exact
+ * two-sums throughout, so that they stay accurate under cancellation.
+ */
+static void
+two_sum (double a, double b, double *s, double *e)
+{
+  double v;
+  *s = a + b;
+  v = *s - a;
+  *e = (a - (*s - v)) + (b - v);
+}
+
+static void
+dd_add (double ah, double al, double bh, double bl, double *sh, double *sl)
+{
+  double s, e, t, f;
+  two_sum (ah, bh, &s, &e);
+  two_sum (al, bl, &t, &f);
+  e += t;
+  two_sum (s, e, &s, &e);
+  e += f;
+  two_sum (s, e, sh, sl);
+}
+
+static void
+dd_mul (double ah, double al, double bh, double bl, double *ph, double *pl)
+{
+  double p = ah * bh;
+  double e = fma (ah, bh, -p) + ah * bl + al * bh;
+  *ph = p + e;
+  *pl = e - (*ph - p);
+}
+
+/* (ah + al) / c for a double c */
+static void
+dd_div (double ah, double al, double c, double *qh, double *ql)
+{
+  double q = ah / c;
+  double e = (fma (-q, c, ah) + al) / c;
+  *qh = q + e;
+  *ql = e - (*qh - q);
+}
+
+/* Build the entries after lfact_built through to, with lfact_lock held */
+static void
+lfact_extend (int to)
+{
+  double *t = lfact;
+  double lh = lfact_lh, ll = lfact_ll;	/* log(n) */
+  double fh, fl;			/* log(n!) */
+  int n, j;
+
+  for (n = lfact_built + 1; n <= to; n++)
+    {
+      /* s = 1/(2n-1), and the series s + s^3/3 + s^5/5 + ... */
+      double d = 2.0 * n - 1;
+      double sh, sl, s2h, s2l, ph, pl, ah, al;
+      if (n < 2)
+	{
+	  t[2 * n] = t[2 * n + 1] = 0;
+	  continue;
+	}
+      dd_div (1, 0, d, &sh, &sl);
+      dd_mul (sh, sl, sh, sl, &s2h, &s2l);
+      ah = sh;
+      al = sl;
+      ph = sh;
+      pl = sl;
+      for (j = 3;; j += 2)
+	{
+	  double th, tl;
+	  dd_mul (ph, pl, s2h, s2l, &ph, &pl);
+	  dd_div (ph, pl, j, &th, &tl);
+	  if (th < 1e-34 * ah)
+	    break;
+	  dd_add (ah, al, th, tl, &ah, &al);
+	}
+      dd_add (lh, ll, 2 * ah, 2 * al, &lh, &ll);
+      dd_add (t[2 * n - 2], t[2 * n - 1], lh, ll, &fh, &fl);
+      t[2 * n] = fh;
+      t[2 * n + 1] = fl;
+    }
+  lfact_lh = lh;
+  lfact_ll = ll;
+  __atomic_store_n (&lfact_built, to, __ATOMIC_RELEASE);
+}
+
+/* The table as hi, lo pairs by n, built at least through n, or NULL if it
+ * could not be allocated. n is at most LFACT_MAX.
+ */
+const double *
+lfact_table (int n)
+{
+  if (n <= __atomic_load_n (&lfact_built, __ATOMIC_ACQUIRE))
+    return lfact;
+  pthread_mutex_lock (&lfact_lock);
+  if (lfact == NULL)
+    lfact = malloc (2 * (LFACT_MAX + 1) * sizeof (double));
+  if (lfact != NULL && n > lfact_built)
+    {
+      int to = (n / LFACT_BLOCK + 1) * LFACT_BLOCK - 1;
+      lfact_extend (to < LFACT_MAX ? to : LFACT_MAX);
+    }
+  pthread_mutex_unlock (&lfact_lock);
+  return lfact;
+}
+
+/* log(choose(r, x) choose(b, n-x) / choose(r+b, n)) from the table, for
+ * integers within its range with 0 <= x <= r, 0 <= n-x <= b.
+ */
+double
+lfact_ldhyper (const double *t, int x, int r, int b, int n)
+{
+  int terms[9] = { r, b, n, r + b - n, x, r - x, n - x, b - n + x, r + b };
+  double sh = 0, sl = 0;
+  int j;
+
+  for (j = 0; j < 9; j++)
+    {
+      const double *e = t + 2 * terms[j];
+      if (j < 4)
+	dd_add (sh, sl, e[0], e[1], &sh, &sl);
+      else
+	dd_add (sh, sl, -e[0], -e[1], &sh, &sl);
+    }
+  return sh + sl;
+}
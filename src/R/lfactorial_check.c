@@ -0,0 +1,94 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  DESCRIPTION
+ *
+ *    Compares the log densities of dhyper from the log-factorial table with
+ *    R's formula, the dbinom_raw ratio dhyper used before, on random tables
+ *    with margins of a range of sizes and x within a few standard
+ *    deviations of the mean. The reference is the same nine log-factorial
+ *    sum in quad precision, from libquadmath's lgammaq.
+ *
+ *    Build and run it with "make check" in this directory. It prints, for
+ *    each range of m + n, the largest absolute error of the log density of
+ *    each method, which is also the largest relative error of the density,
+ *    over the tables whose density does not underflow.
+ */
+
+#include <math.h>
+#include <quadmath.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "fun.h"
+
+#define CHECK_TABLES 20000
+
+/* A small deterministic generator, so that every run checks the same tables */
+static uint64_t state = 88172645463325252ULL;
+
+static double
+uniform (double n)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return floor ((double) (state >> 11) / 9007199254740992.0 * n);
+}
+
+static __float128
+lfactq (double n)
+{
+  return lgammaq ((__float128) n + 1);
+}
+
+int
+main (void)
+{
+  static const double ranges[] = { 100, 10000, 100000, 1048576 };
+  int i, j;
+
+  printf ("%-10s %-12s %-12s\n", "m + n <=", "table", "R formula");
+  for (i = 0; i < 4; i++)
+    {
+      double table = 0, formula = 0;
+      for (j = 0; j < CHECK_TABLES; j++)
+	{
+	  double N = 2 + uniform (ranges[i] - 1);
+	  double r = uniform (N + 1), b = N - r;
+	  double n = uniform (N + 1);
+	  double lo = fmax (0, n - b), hi = fmin (n, r);
+	  double sd = sqrt (n * r * b * (N - n) / (N * N * (N - 1)));
+	  double x = round (n * r / N + (uniform (1001) / 1000 - 0.5) * 8 * sd);
+	  x = fmin (hi, fmax (lo, x));
+	  double p = n / N, q = (N - n) / N;
+	  __float128 ref = lfactq (r) + lfactq (b) + lfactq (n) + lfactq (N - n)
+	    - lfactq (x) - lfactq (r - x) - lfactq (n - x) - lfactq (b - n + x)
+	    - lfactq (N);
+	  double t = dhyper (x, r, b, n, 1);
+	  double f = n == 0 ? 0 : dbinom_raw (x, r, p, q, 1)
+	    + dbinom_raw (n - x, b, p, q, 1) - dbinom_raw (n, N, p, q, 1);
+	  if (ref < -700)
+	    continue;
+	  table = fmax (table, fabs ((double) (t - ref)));
+	  formula = fmax (formula, fabs ((double) (f - ref)));
+	}
+      printf ("%-10.0f %-12.3g %-12.3g\n", ranges[i], table, formula);
+    }
+  return 0;
+}
@@ -0,0 +1,137 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+
+/*
+ *  DESCRIPTION
+ *
+ *    The distribution function of the binomial distribution.
+ *
+ *    R computes pbinom from the incomplete beta function. Here the shorter
+ *    tail is summed instead, the same way pdhyper in phyper.c sums the
+ *    hypergeometric one: the density at x comes from dbinom_raw, and each
+ *    further term from the previous one by the density ratio. The terms
+ *    fall off at least geometrically away from the mean, so the sum stops
+ *    after a few standard deviations, and small tail probabilities keep
+ *    their full relative accuracy.
+ *
+ *    Near the mean of a distribution with a large variance that sum would
+ *    take on the order of a standard deviation of terms, so there the tail
+ *    comes from the incomplete beta function as in R, by the asymptotic
+ *    expansion basym that R's pbeta uses in the same place, at a cost that
+ *    does not grow with n. Farther out, and for small variances, the sum
+ *    takes at most about 1500 terms.
+ */
+
+#include <float.h>
+#include <math.h>
+#include "dpq.h"
+#include "fun.h"
+
+/* basym is used when both beta parameters n - x and x + 1 are above
+ * PBINOM_BASYM_MIN and lambda is within PBINOM_BASYM_WIDTH of the smaller
+ * one, the bounds of R's bratio.
+ */
+#define PBINOM_BASYM_MIN   100
+#define PBINOM_BASYM_WIDTH 0.03
+#define PBINOM_BASYM_EPS   1e-15
+
+static double
+pdbinom (double x, double n, double p, double q, int log_p)
+{
+/*
+ * Calculate
+ *
+ *	    pbinom (x, n, p, TRUE, FALSE)
+ *   [log]  -----------------------------
+ *	       dbinom (x, n, p, FALSE)
+ *
+ * without actually calling pbinom.  This assumes that  x <= n * p.
+ */
+  long double sum = 0;
+  long double term = 1;
+
+  while (x > 0 && term >= DBL_EPSILON * sum)
+  {
+    term *= x * q / ((n - x + 1) * p);
+    sum += term;
+    x--;
+  }
+
+  double ss = (double) sum;
+  return log_p ? log1p(ss) : 1 + ss;
+}
+
+double
+pbinom (double x, double n, double p, int lower_tail, int log_p)
+{
+  double q, d, pd;
+
+  if (isnan (x) || isnan (n) || isnan (p))
+    return x + n + p;
+  if (!isfinite (n) || !isfinite (p))
+    return NAN;
+  if (R_nonint (n) || n < 0 || p < 0 || p > 1)
+    return NAN;
+
+  x = floor (x + 1e-7);
+  n = round (n);
+  q = 1 - p;
+
+  if (x < 0)
+    return R_DT_0;
+  if (x >= n)
+    return R_DT_1;
+
+  /* P(X <= x) = I_q(n - x, x + 1), the lower beta tail when
+   * lambda = (n - x) - (n + 1) q = (n + 1) p - (x + 1) >= 0. Otherwise
+   * P(X > x) = I_p(x + 1, n - x) is the lower one. A log tail that
+   * underflows is summed after all, since far tails take few terms.
+   * lambda comes from p before the tails are swapped, since q = 1 - p is
+   * rounded and n times its error would show in the tail.
+   */
+  d = fmin (n - x, x + 1);
+  pd = fma (n + 1, p, -(x + 1));
+  if (d > PBINOM_BASYM_MIN && fabs (pd) <= PBINOM_BASYM_WIDTH * d)
+  {
+    int below = pd >= 0;
+    d = below ? basym (n - x, x + 1, pd, PBINOM_BASYM_EPS)
+              : basym (x + 1, n - x, -pd, PBINOM_BASYM_EPS);
+    if (!log_p)
+      return below ? R_D_Lval (d) : R_D_Cval (d);
+    if (d > 0)
+      return below ? R_DT_Log (log (d)) : R_DT_Clog (log (d));
+  }
+
+  if (x > n * p)
+  {
+    /* Swap tails: n - X is binomial with probability q */
+    double oldp = p;
+    p = q;
+    q = oldp;
+    x = n - x - 1;
+    lower_tail = !lower_tail;
+    if (x < 0)
+      return R_DT_0;
+  }
+
+  d  = dbinom_raw (x, n, p, q, log_p);
+  pd = pdbinom (x, n, p, q, log_p);
+
+  return log_p ? R_DT_Log (d + pd) : R_D_Lval (d * pd);
+}
@@ -0,0 +1,235 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+
+/*
+ *  DESCRIPTION
+ *
+ *    The distribution function of the Poisson distribution.
+ *
+ *    R computes ppois from the incomplete gamma function. Here the shorter
+ *    tail is summed instead, as pbinom.c does: below the mean the lower
+ *    tail from x down, otherwise the upper tail from x + 1 up, with each
+ *    term from the previous one by the density ratio.
+ *
+ *    Near the mean of a large lambda that sum would take on the order of
+ *    sqrt(lambda) terms, so there the tail comes from Temme's uniform
+ *    asymptotic expansion of the incomplete gamma function instead, at a
+ *    cost that does not grow with lambda. Farther out, and for small
+ *    lambda, the sum takes at most about 1500 terms.
+ */
+
+#include <float.h>
+#include <math.h>
+#include "dpq.h"
+#include "fun.h"
+
+/* Temme's expansion is used for lambda above PPOIS_TEMME_LAMBDA and x + 1
+ * within PPOIS_TEMME_WIDTH * lambda of it.
+ */
+#define PPOIS_TEMME_LAMBDA 1000
+#define PPOIS_TEMME_WIDTH  0.03
+
+/* The expansion keeps TEMME_ORDERS powers of 1/a, and the Taylor series
+ * of their coefficients in eta TEMME_TERMS terms, plenty for |eta| < 0.05.
+ */
+#define TEMME_ORDERS 5
+#define TEMME_TERMS  26
+
+/* The Taylor coefficients of c_0(eta) ... c_4(eta), from the exact series
+ * of c_0 = 1/mu - 1/eta and c_k = c_{k-1}'(eta) / eta + (-1)^k g_k / mu,
+ * with g_k the coefficients of Stirling's series. These are DiDonato and
+ * Morris's d0 ... d4.
+ */
+static const double temme_c[TEMME_ORDERS][TEMME_TERMS] = {
+  {
+    -0.3333333333333333, 0.08333333333333333, -0.014814814814814815,
+    0.0011574074074074073, 0.0003527336860670194, -0.0001787551440329218,
+    3.919263178522438e-05, -2.185448510679992e-06, -1.85406221071516e-06,
+    8.296711340953087e-07, -1.7665952736826078e-07, 6.707853543401498e-09,
+    1.0261809784240309e-08, -4.382036018453353e-09, 9.14769958223679e-10,
+    -2.5514193994946248e-11, -5.830772132550426e-11, 2.4361948020667415e-11,
+    -5.0276692801141755e-12, 1.1004392031956135e-13, 3.371763262400985e-13,
+    -1.392388722418162e-13, 2.8534893807047445e-14, -5.139111834242572e-16,
+    -1.9752288294349442e-15, 8.099521156704561e-16
+  },
+  {
+    -0.001851851851851852, -0.003472222222222222, 0.0026455026455026454,
+    -0.0009902263374485596, 0.00020576131687242798, -4.018775720164609e-07,
+    -1.8098550334489977e-05, 7.64916091608111e-06, -1.6120900894563446e-06,
+    4.647127802807434e-09, 1.378633446915721e-07, -5.752545603517705e-08,
+    1.1951628599778148e-08, -1.7543241719747647e-11, -1.0091543710600413e-09,
+    4.162792991842583e-10, -8.56390702649298e-11, 6.067215101604758e-14,
+    7.1624989648114856e-12, -2.933186643771437e-12, 5.996696365683689e-13,
+    -2.1671786527323313e-16, -4.978339972369262e-14, 2.0291628823713425e-14,
+    -4.13125571381061e-15, 8.286516239883097e-19
+  },
+  {
+    0.004133597883597883, -0.0026813271604938273, 0.0007716049382716049,
+    2.0093878600823047e-06, -0.0001073665322636516, 5.2923448829120125e-05,
+    -1.2760635188618728e-05, 3.423578734096138e-08, 1.3721957309062934e-06,
+    -6.298992138380055e-07, 1.4280614206064242e-07, -2.0477098421990866e-10,
+    -1.409252991086752e-08, 6.228974084922022e-09, -1.3670488396617114e-09,
+    9.428356159014678e-13, 1.2872252400089318e-10, -5.5645956134363323e-11,
+    1.197593554636698e-11, -4.1689782251838634e-15, -1.0940640427884595e-12,
+    4.662239946390136e-13, -9.905105763906907e-14, 1.8931876768373515e-17,
+    8.859221872591127e-15, -3.737820398046405e-15
+  },
+  {
+    0.0006494341563786008, 0.00022947209362139917, -0.0004691894943952557,
+    0.00026772063206283885, -7.561801671883977e-05, -2.396505113867297e-07,
+    1.1082654115347302e-05, -5.6749528269915965e-06, 1.4230900732435883e-06,
+    -2.7861080291528143e-11, -1.6958404091930278e-07, 8.099464905388083e-08,
+    -1.9111168485973655e-08, 2.3928620439808118e-12, 2.0620131815488797e-09,
+    -9.460496661855133e-10, 2.1541049775774907e-10, -1.388823336813903e-14,
+    -2.1894761681963938e-11, 9.790998951171684e-12, -2.178219188018096e-12,
+    6.208819573407901e-17, 2.126978363279737e-13, -9.344688791517433e-14,
+    2.045367122678285e-14, -2.58260790403495e-19
+  },
+  {
+    -0.0008618882909167117, 0.0007840392217200666, -0.0002990724803031902,
+    -1.4638452578843418e-06, 6.641498215465122e-05, -3.968365047179435e-05,
+    1.1375726970678419e-05, 2.507497226237533e-10, -1.6954149536558305e-06,
+    8.907507532205309e-07, -2.292934834000805e-07, 2.956794137544049e-11,
+    2.8865829742708783e-08, -1.4189739437803219e-08, 3.4463580499464896e-09,
+    -2.3024517174528067e-13, -3.9409233028046403e-10, 1.86023389685045e-10,
+    -4.356323005056618e-11, 1.278600101629623e-15, 4.67927502665792e-12,
+    -2.149246470613483e-12, 4.908815614809652e-13, -6.33859148489156e-18,
+    -5.045332069080094e-14, 2.2722958222901286e-14
+  }
+};
+
+/*
+ * Temme's expansion of the incomplete gamma function (DLMF 8.12.3-4):
+ *
+ *   Q(a, x) = erfc(eta sqrt(a/2)) / 2 + R,  P(a, x) = erfc(-eta sqrt(a/2)) / 2 - R,
+ *   R = exp(-a eta^2/2) / sqrt(2 pi a) * sum_k c_k(eta) / a^k,
+ *
+ * where eta^2/2 = mu - log(1 + mu), mu = x/a - 1, and eta has the sign of
+ * mu. Returns Q when upper is set, otherwise P.
+ */
+static double
+temme_gamma (double a, double x, int upper)
+{
+  double mu = (x - a) / a;
+  double r = rlog1 (mu);
+  double eta = copysign (sqrt (2 * r), mu);
+  double s = 0, ak = 1, ck, R;
+  int k, j;
+
+  for (k = 0; k < TEMME_ORDERS; k++)
+    {
+      ck = 0;
+      for (j = TEMME_TERMS - 1; j >= 0; j--)
+        ck = ck * eta + temme_c[k][j];
+      s += ck * ak;
+      ak /= a;
+    }
+  R = exp (-a * r) / sqrt (M_2PI * a) * s;
+  return upper ? 0.5 * erfc (eta * sqrt (a / 2)) + R
+               : 0.5 * erfc (-eta * sqrt (a / 2)) - R;
+}
+
+/*
+ * Calculate
+ *
+ *	    ppois (x, lambda, lower_tail, FALSE)
+ *   [log]  ------------------------------------
+ *	       dpois (x, lambda, FALSE)
+ *
+ * summing away from the mean: downward from x for the lower tail, which
+ * assumes x <= lambda, and upward from x for the upper tail including x,
+ * which assumes x > lambda.
+ */
+static double
+pdpois (double x, double lambda, int lower_tail, int log_p)
+{
+  long double sum = 0;
+  long double term = 1;
+
+  if (lower_tail)
+    {
+      while (x > 0 && term >= DBL_EPSILON * sum)
+        {
+          term *= x / lambda;
+          sum += term;
+          x--;
+        }
+    }
+  else
+    {
+      while (term >= DBL_EPSILON * sum)
+        {
+          x++;
+          term *= lambda / x;
+          sum += term;
+        }
+    }
+
+  double ss = (double) sum;
+  return log_p ? log1p(ss) : 1 + ss;
+}
+
+double
+ppois (double x, double lambda, int lower_tail, int log_p)
+{
+  double d, pd;
+
+  if (isnan (x) || isnan (lambda))
+    return x + lambda;
+  if (lambda < 0)
+    return NAN;
+  if (x < 0)
+    return R_DT_0;
+  if (lambda == 0 || !isfinite (x))
+    return R_DT_1;
+  if (!isfinite (lambda))
+    return R_DT_0;
+
+  x = floor (x + 1e-7);
+
+  if (lambda > PPOIS_TEMME_LAMBDA && fabs (x + 1 - lambda) <= PPOIS_TEMME_WIDTH * lambda)
+    {
+      /* The shorter tail: P(X <= x) = Q(x + 1, lambda) below the mean,
+       * P(X > x) = P(x + 1, lambda) above it. A log tail that underflows
+       * is summed after all, since far tails take few terms.
+       */
+      int below = x + 1 < lambda;
+      d = temme_gamma (x + 1, lambda, below);
+      if (!log_p)
+        return below ? R_D_Lval (d) : R_D_Cval (d);
+      if (d > 0)
+        return below ? R_DT_Log (log (d)) : R_DT_Clog (log (d));
+    }
+
+  if (x > lambda)
+    {
+      /* P(X <= x) = 1 - P(X >= x + 1) */
+      x++;
+      lower_tail = !lower_tail;
+      d  = dpois_raw (x, lambda, log_p);
+      pd = pdpois (x, lambda, 0, log_p);
+    }
+  else
+    {
+      d  = dpois_raw (x, lambda, log_p);
+      pd = pdpois (x, lambda, 1, log_p);
+    }
+
+  return log_p ? R_DT_Log (d + pd) : R_D_Lval (d * pd);
+}
@@ -0,0 +1,173 @@
+/*
+ *  Mathlib : A C Library of Special Functions
+ *  Copyright (C) 1998 Ross Ihaka
+ *  Copyright (C) 2000-2014 The R Core Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, a copy is available at
+ *  http://www.r-project.org/Licenses/
+ *
+ *  DESCRIPTION
+ *
+ *	The quantile function of the binomial distribution.
+ *
+ *  The search starts from R's Cornish-Fisher approximation, with a rough
+ *  normal quantile in place of qnorm(). pbinom() sums a tail rather than
+ *  evaluating an incomplete beta function here, so it is called once, at
+ *  the start, and the search then walks one point at a time, adding or
+ *  removing the density of each point. R's stepwise search with pbinom()
+ *  remains for densities that underflow.
+ */
+
+#include <float.h>
+#include <math.h>
+#include "dpq.h"
+#include "fun.h"
+
+/* The standard normal quantile to within 4.5e-4, after Abramowitz and
+ * Stegun 26.2.23, for 0 < p < 1.
+ */
+static double
+qnorm_rough (double p)
+{
+  double t = sqrt (-2 * log (p < 0.5 ? p : 1 - p));
+  double z = t - (2.515517 + t * (0.802853 + t * 0.010328))
+               / (1 + t * (1.432788 + t * (0.189269 + t * 0.001308)));
+  return p < 0.5 ? -z : z;
+}
+
+static double
+do_search (double y, double *z, double p, double n, double pr, double incr)
+{
+  if (*z >= p)
+    {
+      /* search to the left */
+      for (;;)
+        {
+          double newz;
+          if (y == 0 || (newz = pbinom (y - incr, n, pr, 1, 0)) < p)
+            return y;
+          y = fmax2 (0, y - incr);
+          *z = newz;
+        }
+    }
+  else
+    {
+      /* search to the right */
+      for (;;)
+        {
+          y = y + incr < n ? y + incr : n;
+          if (y == n)
+            {
+              *z = 1;
+              return y;
+            }
+          if ((*z = pbinom (y, n, pr, 1, 0)) >= p)
+            return y;
+        }
+    }
+}
+
+double
+qbinom (double p, double n, double pr, int lower_tail, int log_p)
+{
+  double q, mu, sigma, gamma, z, y, d, incr, oldincr;
+
+  if (isnan (p) || isnan (n) || isnan (pr))
+    return p + n + pr;
+  if (!isfinite (n) || !isfinite (pr))
+    return NAN;
+  if (!isfinite (p) && !log_p)
+    return NAN;
+  if (n != floor (n + 0.5))
+    return NAN;
+  if (pr < 0 || pr > 1 || n < 0)
+    return NAN;
+
+  if (log_p ? p > 0 : (p < 0 || p > 1))
+    return NAN;
+  if (p == R_DT_0)
+    return 0;
+  if (p == R_DT_1)
+    return n;
+
+  if (pr == 0. || n == 0)
+    return 0.;
+
+  q = 1 - pr;
+  if (q == 0.)
+    return n;                   /* covers the full range of the distribution */
+  mu = n * pr;
+  sigma = sqrt (n * pr * q);
+  gamma = (q - pr) / sigma;
+
+  if (!lower_tail || log_p)
+    {
+      p = R_DT_qIv (p);         /* need check again (cancellation!): */
+      if (p == 0.)
+        return 0.;
+      if (p == 1.)
+        return n;
+    }
+  /* temporary hack --- FIXME --- */
+  if (p + 1.01 * DBL_EPSILON >= 1.)
+    return n;
+
+  /* y := approx.value (Cornish-Fisher expansion) :  */
+  z = qnorm_rough (p);
+  y = floor (mu + sigma * (z + gamma * (z * z - 1) / 6) + 0.5);
+  if (y > n)                    /* way off */
+    y = n;
+  if (y < 0)
+    y = 0;
+  z = pbinom (y, n, pr, 1, 0);
+
+  /* fuzz to ensure left continuity: */
+  p *= 1 - 64 * DBL_EPSILON;
+
+  d = dbinom_raw (y, n, pr, q, 0);
+  if (z >= p)
+    {
+      while (d > 0)
+        {
+          if (y == 0 || z - d < p)
+            return y;
+          z -= d;
+          d *= y * q / ((n - y + 1) * pr);
+          y--;
+        }
+    }
+  else
+    {
+      while (d > 0)
+        {
+          if (y == n)
+            return y;
+          d *= (n - y) * pr / ((y + 1) * q);
+          y++;
+          z += d;
+          if (z >= p)
+            return y;
+        }
+    }
+
+  incr = fmax2 (1, floor (sigma));
+  do
+    {
+      oldincr = incr;
+      y = do_search (y, &z, p, n, pr, incr);
+      incr = fmax2 (1, floor (incr / 8));
+    }
+  while (oldincr > 1);
+  return y;
+}
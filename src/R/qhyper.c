@@ -0,0 +1,94 @@
+/*
+ *  Mathlib : A C Library of Special Functions
+ *  Copyright (C) 1998 Ross Ihaka
+ *  Copyright (C) 2000-2014 The R Core Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, a copy is available at
+ *  http://www.r-project.org/Licenses/
+ *
+ *  DESCRIPTION
+ *
+ *	The quantile function of the hypergeometric distribution.
+ *
+ *  The starting term is dhyper at the lower end of the support here,
+ *  rather than a ratio of lfastchoose() binomial coefficients, so that
+ *  lbeta() and lgammafn() need not come along.
+ */
+
+#include <float.h>
+#include <math.h>
+#include "dpq.h"
+#include "fun.h"
+
+double
+qhyper (double p, double NR, double NB, double n, int lower_tail, int log_p)
+{
+/* This is basically the same code as  ./phyper.c  *used* to be --> FIXME! */
+  int small_N;
+  double N, xstart, xend, xr, xb, sum, term;
+
+  if (isnan (p) || isnan (NR) || isnan (NB) || isnan (n))
+    return p + NR + NB + n;
+  if (!isfinite (p) || !isfinite (NR) || !isfinite (NB) || !isfinite (n))
+    return NAN;
+  NR = round (NR);
+  NB = round (NB);
+  N = NR + NB;
+  n = round (n);
+  if (NR < 0 || NB < 0 || n < 0 || n > N)
+    return NAN;
+
+  /* Goal:  Find  xr (= #{red balls in sample}) such that
+   *   phyper(xr)  >= p > phyper(xr - 1) */
+
+  xstart = fmax2 (0, n - NB);
+  xend = n < NR ? n : NR;
+
+  if (log_p ? p > 0 : (p < 0 || p > 1))
+    return NAN;
+  if (p == R_DT_0)
+    return xstart;
+  if (p == R_DT_1)
+    return xend;
+
+  xr = xstart;
+  xb = n - xr;/* always ( = #{black balls in sample} ) */
+
+  small_N = (N < 1000); /* won't have underflow in product below */
+  /* if N is small,  term := product.ratio( bin.coef );
+     otherwise work with its logarithm to protect against underflow */
+  term = dhyper (xr, NR, NB, n, 1);
+  if (small_N) term = exp (term);
+  NR -= xr;
+  NB -= xb;
+
+  if (!lower_tail || log_p)
+  {
+    p = R_DT_qIv (p);
+  }
+  p *= 1 - 1000*DBL_EPSILON;
+  sum = small_N ? term : exp (term);
+
+  while (sum < p && xr < xend)
+  {
+    xr++;
+    NB++;
+    if (small_N) term *= (NR / xr) * (xb / NB);
+    else term += log (NR / xr) + log (xb / NB);
+    sum += small_N ? term : exp (term);
+    xb--;
+    NR--;
+  }
+  return xr;
+}
@@ -0,0 +1,335 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <boost/assign.hpp>
+
+#include "query/FunctionLibrary.h"
+#include "query/FunctionDescription.h"
+#include "query/Aggregate.h"
+
+using namespace std;
+using namespace scidb;
+using namespace boost::assign;
+
+/** @file bar.cpp
+ *
+ * @brief The bar type, the bar aggregate, and their support functions.
+ *
+ * A bar summarizes the trades in a time bucket: open, high, low, close,
+ * volume, volume-weighted average price and trade count. The bar_tick
+ * function makes a one-trade bar out of a time, price and size, and the bar
+ * aggregate merges bars in any order, so all the statistics come out of a
+ * single pass that distributes across instances.
+ *
+ * @par Synopsis: bar_tick (double time, double price, double size),
+ * bar_bucket (double time, double interval), bar (bar) aggregate,
+ * bar_open (bar), bar_high (bar), bar_low (bar), bar_close (bar),
+ * bar_volume (bar), bar_vwap (bar), bar_count (bar)
+ *
+ * @par Examples:
+ * <br>
+ * redimension(
+ *   apply(trades, bucket, bar_bucket(t, 60), b, bar_tick(t, price, size)),
+ *   <b:bar null>[symbol_id=0:*,100,0, bucket=0:*,1440,0], bar(b) as b)
+ **/
+
+/* The running state of a bar, also the bar type itself. An empty bar has a
+ * zero count. The open and close prices belong to the earliest and latest
+ * trade times; trades at identical times are ordered by price so that the
+ * result does not depend on the order in which bars are merged.
+ */
+struct Bar
+{
+  double   first_time;
+  double   last_time;
+  double   open;
+  double   high;
+  double   low;
+  double   close;
+  double   volume;
+  double   notional;   // sum of price * size, for the VWAP
+  uint64_t count;
+};
+
+static void
+bar_merge(Bar &dst, Bar const &src)
+{
+  if(src.count == 0) return;
+  if(dst.count == 0)
+  {
+    dst = src;
+    return;
+  }
+  if(src.first_time < dst.first_time ||
+     (src.first_time == dst.first_time && src.open < dst.open))
+  {
+    dst.first_time = src.first_time;
+    dst.open = src.open;
+  }
+  if(src.last_time > dst.last_time ||
+     (src.last_time == dst.last_time && src.close > dst.close))
+  {
+    dst.last_time = src.last_time;
+    dst.close = src.close;
+  }
+  if(src.high > dst.high) dst.high = src.high;
+  if(src.low < dst.low) dst.low = src.low;
+  dst.volume   += src.volume;
+  dst.notional += src.notional;
+  dst.count    += src.count;
+}
+
+static inline Bar
+bar_value(const Value *v)
+{
+  Bar b;
+  memcpy(&b, v->data(), sizeof(Bar));
+  return b;
+}
+
+/*
+ * @brief A one-trade bar
+ * @param time (double) The trade time, for example from tm2s
+ * @param price (double) The trade price
+ * @param size (double) The trade size
+ * @returns A bar holding just this trade
+ */
+static void
+bar_tick(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  Bar b;
+  b.first_time = b.last_time = args[0]->getDouble();
+  b.open = b.high = b.low = b.close = args[1]->getDouble();
+  b.volume = args[2]->getDouble();
+  b.notional = b.open * b.volume;
+  b.count = 1;
+  res->setData(&b, sizeof(Bar));
+}
+
+/*
+ * @brief The time bucket containing a time
+ * @param time (double) A time, for example from tm2s
+ * @param interval (double) The bucket width in the same units as time
+ * @returns floor(time / interval), or null unless interval is finite and
+ * positive and the bucket fits in an int64
+ */
+static void
+bar_bucket(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double interval = args[1]->getDouble();
+  double bucket = floor(args[0]->getDouble() / interval);
+/* Converting NaN or an out-of-range double to int64 is undefined; the
+ * negated comparisons also catch a NaN time or interval.
+ */
+  if(!(interval > 0) || isinf(interval) ||
+     !(bucket >= -9223372036854775808.0 && bucket < 9223372036854775808.0))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setInt64((int64_t) bucket);
+}
+
+static void
+bar_open(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(bar_value(args[0]).open);
+}
+
+static void
+bar_high(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(bar_value(args[0]).high);
+}
+
+static void
+bar_low(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(bar_value(args[0]).low);
+}
+
+static void
+bar_close(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(bar_value(args[0]).close);
+}
+
+static void
+bar_volume(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(bar_value(args[0]).volume);
+}
+
+static void
+bar_vwap(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  Bar b = bar_value(args[0]);
+  res->setDouble(b.notional / b.volume);
+}
+
+static void
+bar_count(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setInt64((int64_t) bar_value(args[0]).count);
+}
+
+/* Show a bar as open, high, low, close, volume, vwap, count */
+static void
+bar2string(const Value** args, Value *res, void*)
+{
+  char buf[256];
+  Bar b = bar_value(args[0]);
+  snprintf(buf, sizeof(buf), "%.15g, %.15g, %.15g, %.15g, %.15g, %.15g, %llu",
+           b.open, b.high, b.low, b.close, b.volume, b.notional / b.volume,
+           (unsigned long long) b.count);
+  res->setString(buf);
+}
+
+REGISTER_TYPE(bar, sizeof(Bar));
+REGISTER_FUNCTION(bar_tick, list_of("double")("double")("double"), "bar", bar_tick);
+REGISTER_FUNCTION(bar_bucket, list_of("double")("double"), "int64", bar_bucket);
+REGISTER_FUNCTION(bar_open, list_of("bar"), "double", bar_open);
+REGISTER_FUNCTION(bar_high, list_of("bar"), "double", bar_high);
+REGISTER_FUNCTION(bar_low, list_of("bar"), "double", bar_low);
+REGISTER_FUNCTION(bar_close, list_of("bar"), "double", bar_close);
+REGISTER_FUNCTION(bar_volume, list_of("bar"), "double", bar_volume);
+REGISTER_FUNCTION(bar_vwap, list_of("bar"), "double", bar_vwap);
+REGISTER_FUNCTION(bar_count, list_of("bar"), "int64", bar_count);
+REGISTER_CONVERTER(bar, string, EXPLICIT_CONVERSION_COST, bar2string);
+
+/* The bar aggregate: the state is itself a bar, so accumulating an input
+ * and merging partial states from other instances are the same operation.
+ */
+class BarAggregate : public Aggregate
+{
+public:
+  BarAggregate(const string& name, Type const& aggregateType):
+    Aggregate(name, aggregateType, aggregateType)
+  {}
+
+  AggregatePtr clone() const
+  {
+    return AggregatePtr(new BarAggregate(getName(), getAggregateType()));
+  }
+
+  AggregatePtr clone(Type const& aggregateType) const
+  {
+    return AggregatePtr(new BarAggregate(getName(), aggregateType));
+  }
+
+  Type getStateType() const
+  {
+    return getAggregateType();
+  }
+
+  bool ignoreNulls() const
+  {
+    return true;
+  }
+
+  void initializeState(Value& state)
+  {
+    Bar b;
+    memset(&b, 0, sizeof(Bar));
+    state.setData(&b, sizeof(Bar));
+  }
+
+  void accumulate(Value& state, Value const& input)
+  {
+    merge(state, input);
+  }
+
+  void merge(Value& dstState, Value const& srcState)
+  {
+    Bar dst = bar_value(&dstState);
+    bar_merge(dst, bar_value(&srcState));
+    dstState.setData(&dst, sizeof(Bar));
+  }
+
+  void finalResult(Value& result, Value const& state)
+  {
+    if(state.isNull() || bar_value(&state).count == 0)
+    {
+      result.setNull(0);
+      return;
+    }
+    result = state;
+  }
+};
+
+static class bar_aggregates
+{
+public:
+  bar_aggregates()
+  {
+    AggregateLibrary::getInstance()->addAggregate(
+      AggregatePtr(new BarAggregate("bar", TypeLibrary::getType("bar"))), "superfunpack");
+  }
+} _bar_aggregates;
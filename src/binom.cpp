@@ -0,0 +1,244 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+
+#include <boost/assign.hpp>
+
+#include "query/FunctionLibrary.h"
+#include "query/FunctionDescription.h"
+
+#include "R/fun.h"
+
+using namespace std;
+using namespace scidb;
+using namespace boost::assign;
+
+/** @file binom.cpp
+ *
+ * @brief Binomial and Poisson distribution functions and the exact binomial
+ * test, on the R density kernels in src/R.
+ *
+ * @par Synopsis: dbinom (double x, double size, double prob),
+ * pbinom (double x, double size, double prob, bool lower_tail),
+ * qbinom (double p, double size, double prob, bool lower_tail),
+ * binom_test_p_value (double x, double n, double p, string alternative),
+ * dpois (double x, double lambda),
+ * ppois (double x, double lambda, bool lower_tail)
+ **/
+
+/* The p-value of R's binom.test. The two-sided test adds up the outcomes on
+ * the far side of the mean that are at most as likely as x, up to R's
+ * relative error of 1e-7. The densities fall away monotonically on either
+ * side of the mean, so the first of them is found by bisection, comparing
+ * log densities so that the far tail does not underflow to ties.
+ */
+static double
+binom_test(double x, double n, double p, string const& a)
+{
+  x = round(x);
+  n = round(n);
+  if(x < 0 || x > n || p < 0 || p > 1) return NAN;
+  if(a == "less") return pbinom(x, n, p, 1, 0);
+  if(a == "greater") return pbinom(x - 1, n, p, 0, 0);
+// Default to two.sided
+  if(p == 0) return x == 0;
+  if(p == 1) return x == n;
+  double limit = dbinom(x, n, p, 1) + log(1 + 1e-7);
+  double m = n*p;
+  if(x == m) return 1;
+  double pval;
+  if(x < m)
+  {
+// The first point above the mean at most as likely as x
+    double lo = ceil(m), hi = n + 1;
+    while(lo < hi)
+    {
+      double j = floor((lo + hi)/2);
+      if(dbinom(j, n, p, 1) <= limit) hi = j;
+      else lo = j + 1;
+    }
+    pval = pbinom(x, n, p, 1, 0) + pbinom(lo - 1, n, p, 0, 0);
+  } else
+  {
+// The last point below the mean at most as likely as x
+    double lo = -1, hi = floor(m);
+    while(lo < hi)
+    {
+      double j = ceil((lo + hi)/2);
+      if(dbinom(j, n, p, 1) <= limit) lo = j;
+      else hi = j - 1;
+    }
+    pval = pbinom(lo, n, p, 1, 0) + pbinom(x - 1, n, p, 0, 0);
+  }
+  return min(1.0, pval);
+}
+
+/*
+ * @brief Binomial probability density function
+ * @param x (double) The number of successes.
+ * @param size (double) The number of trials.
+ * @param prob (double) The probability of success on each trial.
+ * @returns The binomial density at x.
+ */
+static void
+superfun_dbinom(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double size = args[1]->getDouble();
+  double prob = args[2]->getDouble();
+  res->setDouble(dbinom(x, size, prob, 0));
+}
+
+/*
+ * @brief Binomial cumulative distribution
+ * @param x (double) The number of successes.
+ * @param size (double) The number of trials.
+ * @param prob (double) The probability of success on each trial.
+ * @param lower_tail (boolean) TRUE for P(X <= x), FALSE for P(X > x).
+ * @returns The binomial cumulative distribution up to x
+ */
+static void
+superfun_pbinom(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double size = args[1]->getDouble();
+  double prob = args[2]->getDouble();
+  bool lower_tail = args[3]->getBool();
+  res->setDouble(pbinom(x, size, prob, lower_tail, 0));
+}
+
+/*
+ * @brief Binomial quantile function
+ * @param p (double) The probability (0 <= p <= 1)
+ * @param size (double) The number of trials.
+ * @param prob (double) The probability of success on each trial.
+ * @param lower_tail (boolean) TRUE for lower tail quantile, FALSE for upper.
+ * @returns The smallest number of successes x with P(X <= x) >= p.
+ */
+static void
+superfun_qbinom(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double p = args[0]->getDouble();
+  double size = args[1]->getDouble();
+  double prob = args[2]->getDouble();
+  bool lower_tail = args[3]->getBool();
+  res->setDouble(qbinom(p, size, prob, lower_tail, 0));
+}
+
+/*
+ * @brief Exact binomial test p-value
+ * @param x (double) The number of successes.
+ * @param n (double) The number of trials.
+ * @param p (double) The hypothesized probability of success.
+ * @param alternative (string) one of {"less","greater","two.sided"}
+ * @returns The p-value of R's binom.test.
+ */
+static void
+superfun_binom_test_p_value(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double n = args[1]->getDouble();
+  double p = args[2]->getDouble();
+  string a = args[3]->getString();
+  res->setDouble(binom_test(x, n, p, a));
+}
+
+/*
+ * @brief Poisson probability density function
+ * @param x (double) The number of events.
+ * @param lambda (double) The mean number of events.
+ * @returns The Poisson density at x.
+ */
+static void
+superfun_dpois(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double lambda = args[1]->getDouble();
+  res->setDouble(dpois(x, lambda, 0));
+}
+
+/*
+ * @brief Poisson cumulative distribution
+ * @param x (double) The number of events.
+ * @param lambda (double) The mean number of events.
+ * @param lower_tail (boolean) TRUE for P(X <= x), FALSE for P(X > x).
+ * @returns The Poisson cumulative distribution up to x
+ */
+static void
+superfun_ppois(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double lambda = args[1]->getDouble();
+  bool lower_tail = args[2]->getBool();
+  res->setDouble(ppois(x, lambda, lower_tail, 0));
+}
+
+REGISTER_FUNCTION(dbinom, list_of("double")("double")("double"), "double", superfun_dbinom);
+REGISTER_FUNCTION(pbinom, list_of("double")("double")("double")("bool"), "double", superfun_pbinom);
+REGISTER_FUNCTION(qbinom, list_of("double")("double")("double")("bool"), "double", superfun_qbinom);
+REGISTER_FUNCTION(binom_test_p_value, list_of("double")("double")("double")("string"), "double", superfun_binom_test_p_value);
+REGISTER_FUNCTION(dpois, list_of("double")("double"), "double", superfun_dpois);
+REGISTER_FUNCTION(ppois, list_of("double")("double")("bool"), "double", superfun_ppois);
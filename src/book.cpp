@@ -0,0 +1,1814 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/assign.hpp>
+
+#include "query/FunctionLibrary.h"
+#include "query/FunctionDescription.h"
+#include "query/Aggregate.h"
+#include "system/ErrorsLibrary.h"
+
+#include "superfunpack.h"
+#include "book.h"
+
+using namespace std;
+using namespace scidb;
+using namespace boost::assign;
+
+/** @file book.cpp
+ *
+ * @brief Financial market order book support: the book type and the
+ * book function on both the string and binary book representations.
+ *
+ * Prices are kept as integer multiples of a tick size (0.001 unless given),
+ * so that prices that differ only by floating point rounding consolidate to
+ * the same level, and book sides are kept as arrays sorted best price first
+ * so that books consolidate with a linear merge that stops at the requested
+ * depth. The book_merge aggregate consolidates any number of binary books
+ * at once with a k-way merge.
+ *
+ * @par Synopsis: book (string x, string y, uint32 depth [, double tick]),
+ * book (book x, book y, uint32 depth), book (string [, double tick]),
+ * book_depth (book x, uint32 depth), book_merge (book) aggregate,
+ * book_mid (x), book_spread (x), book_imbalance (x, uint32 depth),
+ * book_vwap (x, string side, double qty) on string or binary books x,
+ * book_diff (book prev, book cur [, int64 seq]), book_keyframe (book x,
+ * int64 seq), book_apply (book prev, book_delta delta),
+ * book_rebuild (book_delta) aggregate, book_pack (double bid_price_1,
+ * double bid_size_1, ..., double ask_price_n, double ask_size_n),
+ * book_level (book x, string field, uint32 i)
+ *
+ * @par Examples:
+ * <br>
+ * apply(apply(build(<a:string>[i=1:1,1,0], '1.0,100, 2.0,50 | 4.0,100'),
+ *   b, '1.0,100, 3.5,50 | 5.0,100'), c, book(a, b, 10))
+ *
+ * apply(apply(build(<a:string>[i=1:1,1,0], '1.0,100, 2.0,50 | 4.0,100'),
+ *   b, book('1.0,100, 3.5,50 | 5.0,100')), c, string(book(book(a), b, 10)))
+ *
+ * aggregate(apply(quotes, b, book_depth(book(q), 10)), book_merge(b) as b, symbol_id)
+ **/
+
+/* Order book levels best price first: highest first for bids, lowest first
+ * for asks. Levels with equal prices go smallest size first, so that their
+ * sizes add up the same way whatever order they came in.
+ */
+struct bid_order
+{
+  template<class L>
+  bool operator()(L const& a, L const& b) const
+  {
+    return a.price > b.price || (a.price == b.price && a.size < b.size);
+  }
+};
+struct ask_order
+{
+  template<class L>
+  bool operator()(L const& a, L const& b) const
+  {
+    return a.price < b.price || (a.price == b.price && a.size < b.size);
+  }
+};
+
+/* Powers of ten that are exact in double precision */
+static const double exact_pow10[] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Parse a decimal number at p like strtod does, setting *d and returning
+ * the end of the number, or p when there is no number there. Plain decimals
+ * with at most 19 significant digits whose value is exactly representable
+ * after one multiplication or division by an exact power of ten are parsed
+ * directly, that result is correctly rounded. Everything else, including
+ * nan, inf and hexadecimal numbers, goes to strtod. The string must be
+ * terminated by a non-numeric character, in practice the book delimiters or
+ * the final NUL.
+ */
+static inline const char *
+parse_double(const char *p, double *d)
+{
+  const char *start = p, *q;
+  uint64_t m = 0;
+  int digits = 0, exp10 = 0;
+  bool negative = false;
+  char *endptr;
+
+  while(isspace((unsigned char) *p)) ++p;
+  if(*p == '-' || *p == '+') negative = (*p++ == '-');
+  if(p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) goto fallback;
+  for(q = p; *p >= '0' && *p <= '9'; ++p)
+  {
+    if(m == 0 && *p == '0') continue;
+    if(++digits > 19) goto fallback;
+    m = 10 * m + (*p - '0');
+  }
+  if(*p == '.')
+  {
+    ++p;
+    for(; *p >= '0' && *p <= '9'; ++p)
+    {
+      --exp10;
+      if(m == 0 && *p == '0') continue;
+      if(++digits > 19) goto fallback;
+      m = 10 * m + (*p - '0');
+    }
+    if(p - q == 1) goto fallback;   // a lone "."
+  }
+  if(p == q) goto fallback;         // no digits, maybe nan or inf
+  if(*p == 'e' || *p == 'E')
+  {
+    const char *e = p + 1;
+    bool eneg = false;
+    int x = 0;
+    if(*e == '-' || *e == '+') eneg = (*e++ == '-');
+    if(*e >= '0' && *e <= '9')
+    {
+      for(; *e >= '0' && *e <= '9'; ++e)
+      {
+        if(x < 10000) x = 10 * x + (*e - '0');
+      }
+      exp10 += eneg ? -x : x;
+      p = e;
+    }
+  }
+  if(m > (1ULL << 53) || exp10 < -22 || exp10 > 22) goto fallback;
+  *d = exp10 < 0 ? (double) m / exact_pow10[-exp10] : (double) m * exact_pow10[exp10];
+  if(negative) *d = -*d;
+  return p;
+
+fallback:
+  *d = strtod(start, &endptr);
+  return endptr;
+}
+
+/* Scan one side of a book string, the comma-delimited text in [p, end),
+ * calling level(price, size) for each price/size pair in the order they
+ * appear. Empty fields are skipped, and a price that does not parse drops
+ * its level.
+ */
+template<class F>
+static void
+scan_side(const char *p, const char *end, F level)
+{
+  double d, price = NAN;
+  int j = 0;
+  while(p < end)
+  {
+    if(*p == ',')
+    {
+      ++p;
+      continue;
+    }
+    const char *field = p;
+    const char *next = parse_double(field, &d);
+    bool ok = next != field && next <= end;
+    if(j == 0) price = ok ? d : NAN;
+    else if(ok && !isnan(price)) level(price, d);
+    j = 1 - j;
+    p = (const char *) memchr(field, ',', end - field);
+    if(!p) break;
+  }
+}
+
+/* Find the bid and ask sides of a book string, leaving a side empty when
+ * it is missing. Like strtok, empty sides between pipes are skipped.
+ */
+static void
+split_book(const char *x,
+           const char **bid, const char **bid_end,
+           const char **ask, const char **ask_end)
+{
+  *bid = *bid_end = *ask = *ask_end = x;
+  while(*x == '|') ++x;
+  if(!*x) return;
+  *bid = x;
+  *bid_end = strchr(x, '|');
+  if(!*bid_end) *bid_end = x + strlen(x);
+  for(x = *bid_end; *x == '|'; ++x);
+  *ask = *ask_end = x;
+  if(!*x) return;
+  *ask_end = strchr(x, '|');
+  if(!*ask_end) *ask_end = x + strlen(x);
+}
+
+/* Reject tick sizes that are not positive and finite, which would round
+ * every price to the same or to no level.
+ */
+static inline void
+check_tick(double tick)
+{
+  if(!(tick > 0) || !isfinite(tick))
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_TICK_SIZE);
+  }
+}
+
+/* A support function for the user-visible 'book' function defined
+ * below. This function parses the specially-formatted book string defined
+ * in the book function below, appending its levels, with prices rounded to
+ * the nearest tick, to the supplied bid and ask vectors in the order they
+ * appear. Prices that do not fit in 64 bits of ticks (inf) drop their
+ * level. The string is scanned once and not modified.
+ */
+static void
+parse_book(const char *x, double tick,
+           vector<book_level> *bid,
+           vector<book_level> *ask)
+{
+  check_tick(tick);
+  const char *b, *b_end, *a, *a_end;
+  split_book(x, &b, &b_end, &a, &a_end);
+  vector<book_level> *side = bid;
+  auto add = [&](double price, double size)
+  {
+    if(!(fabs(price / tick) < 9e18)) return;
+    book_level level = {llround(price / tick), size};
+    side->push_back(level);
+  };
+  scan_side(b, b_end, add);
+  side = ask;
+  scan_side(a, a_end, add);
+}
+
+/* Sort the levels of one book side best price first, in place, and sum the
+ * sizes of levels with equal prices. Sides that are in order already, like
+ * the asks of most book strings, are not sorted again.
+ */
+template<class L>
+static void
+consolidate_side(vector<L> &side, bool bid)
+{
+  if(side.empty()) return;
+  if(bid)
+  {
+    if(!is_sorted(side.begin(), side.end(), bid_order())) sort(side.begin(), side.end(), bid_order());
+  } else
+  {
+    if(!is_sorted(side.begin(), side.end(), ask_order())) sort(side.begin(), side.end(), ask_order());
+  }
+  size_t k = 0;
+  for(size_t j = 1; j < side.size(); ++j)
+  {
+    if(side[j].price == side[k].price) side[k].size += side[j].size;
+    else side[++k] = side[j];
+  }
+  side.resize(k + 1);
+}
+
+/* Merge two sides of a book, each sorted best first, summing the sizes of
+ * equal prices and stopping as soon as depth levels have been written.
+ * Returns the number of levels written to out. Set bid for descending (bid)
+ * price order.
+ */
+static uint32_t
+merge_side(const book_level *a, uint32_t na,
+           const book_level *b, uint32_t nb,
+           bool bid, uint32_t depth, book_level *out)
+{
+  uint32_t i = 0, j = 0, k = 0;
+  while(k < depth && (i < na || j < nb))
+  {
+    if(j == nb || (i < na && (bid ? a[i].price > b[j].price : a[i].price < b[j].price)))
+    {
+      out[k++] = a[i++];
+    } else if(i == na || a[i].price != b[j].price)
+    {
+      out[k++] = b[j++];
+    } else
+    {
+      out[k].price = a[i].price;
+      out[k].size  = a[i++].size + b[j++].size;
+      ++k;
+    }
+  }
+  return k;
+}
+
+/* Write the decimal digits of v at p, returning the end */
+static inline char *
+write_uint(char *p, uint64_t v)
+{
+  char buf[20];
+  int n = 0;
+  do
+  {
+    buf[n++] = '0' + v % 10;
+    v /= 10;
+  } while(v);
+  while(n) *p++ = buf[--n];
+  return p;
+}
+
+/* Prices are written with at least this many decimals, and with as many
+ * more as the tick size has, up to BOOK_PRICE_MAX_DECIMALS.
+ */
+#define BOOK_PRICE_MIN_DECIMALS 3
+#define BOOK_PRICE_MAX_DECIMALS 15
+
+/* How write_price writes the prices of one tick size: with decimals
+ * decimals, and, when the tick is a whole number units of 10^-decimals,
+ * with integer arithmetic.
+ */
+struct price_format
+{
+  double  tick;
+  int     decimals;
+  int64_t units;
+};
+
+static price_format
+make_price_format(double tick)
+{
+  price_format f = {tick, BOOK_PRICE_MAX_DECIMALS, 0};
+  for(int d = BOOK_PRICE_MIN_DECIMALS; d <= BOOK_PRICE_MAX_DECIMALS; ++d)
+  {
+    double u = tick * exact_pow10[d];
+    if(!(u < 9e18)) break;
+    int64_t m = llround(u);
+    if(m > 0 && fabs(u - m) <= 2 * DBL_EPSILON * u)   // rounding errors only
+    {
+      f.decimals = d;
+      f.units = m;
+      break;
+    }
+  }
+  return f;
+}
+
+/* Write a price of ticks like "%.*f" with the decimals of the format */
+static inline char *
+write_price(char *p, int64_t ticks, price_format const& f)
+{
+  if(f.units > 0 && llabs(ticks) < INT64_MAX / f.units)
+  {
+    int64_t v = ticks * f.units;
+    uint64_t u = v < 0 ? -(uint64_t) v : v;
+    uint64_t scale = (uint64_t) exact_pow10[f.decimals];
+    if(v < 0) *p++ = '-';
+    p = write_uint(p, u / scale);
+    *p++ = '.';
+    u %= scale;
+    for(int d = f.decimals; d-- > 0; u %= scale)
+    {
+      scale /= 10;
+      *p++ = '0' + u / scale;
+    }
+    return p;
+  }
+  return p + sprintf(p, "%.*f", f.decimals, ticks * f.tick);
+}
+
+/* Write a size like "%.0f", that is rounded to an integer in the current
+ * rounding mode.
+ */
+static inline char *
+write_size(char *p, double size)
+{
+  double r = nearbyint(size);
+  if(fabs(r) < 1e18)
+  {
+    if(signbit(r)) *p++ = '-';
+    return write_uint(p, (uint64_t) fabs(r));
+  }
+  return p + sprintf(p, "%.0f", size);
+}
+
+/* The most characters write_price and write_size take for one level */
+#define BOOK_LEVEL_CHARS 1024
+
+/* Append one side of a book to buf starting at n, in increasing price
+ * order, returning the new length.
+ */
+static size_t
+format_side(vector<char> &buf, size_t n, const book_level *level, uint32_t nlevels,
+            bool reverse, price_format const& f)
+{
+  for(uint32_t j = 0; j < nlevels; ++j)
+  {
+    const book_level &l = level[reverse ? nlevels - 1 - j : j];
+    if(buf.size() - n < BOOK_LEVEL_CHARS) buf.resize(2 * buf.size() + BOOK_LEVEL_CHARS);
+    char *p = &buf[n];
+    if(j > 0)
+    {
+      *p++ = ',';
+      *p++ = ' ';
+    }
+    p = write_price(p, l.price, f);
+    *p++ = ',';
+    *p++ = ' ';
+    p = write_size(p, l.size);
+    n = p - &buf[0];
+  }
+  return n;
+}
+
+/* Format a book in the string book format into buf as a NUL-terminated
+ * string, listing the bids in increasing price order like the asks.
+ */
+static void
+format_book(vector<char> &buf,
+            const book_level *bid, uint32_t nbid,
+            const book_level *ask, uint32_t nask, double tick)
+{
+  size_t n;
+  if(buf.size() < 64 * (nbid + nask) + BOOK_LEVEL_CHARS)
+  {
+    buf.resize(64 * (nbid + nask) + BOOK_LEVEL_CHARS);
+  }
+  price_format f = make_price_format(tick);
+  n = format_side(buf, 0, bid, nbid, true, f);
+  memcpy(&buf[n], " | ", 3);
+  n = format_side(buf, n + 3, ask, nask, false, f);
+  buf[n] = 0;
+}
+
+/* Per-thread scratch space for the book functions, reused across calls. */
+struct book_scratch
+{
+  vector<book_level> xbid, xask, ybid, yask, bid, ask;
+  vector<char> value;
+  vector<char> text;
+};
+
+static book_scratch &
+scratch()
+{
+  static thread_local book_scratch s;
+  s.xbid.clear();
+  s.xask.clear();
+  s.ybid.clear();
+  s.yask.clear();
+  return s;
+}
+
+/* Consolidate two financial market order book strings. This assumes a
+ * very special formatting of the strings:
+ *
+ * bid_price_1, bid_size_1, bid_price_2, bid_size_2, ..., bid_price_m, bid_size_m |
+ * ask_price_1, ask_size_1, ask_price_2, ask_size_2, ..., ask_price_n, ask_size_n
+ *
+ * where the pipe symbol is used to separate the bid and ask sides and they can
+ * each have different numbers of entries that are comma-delimited.
+ */
+static void
+consolidate_books(const Value **args, Value *res, double tick)
+{
+  uint32_t depth = (uint32_t)args[2]->getUint32();
+  book_scratch &s = scratch();
+
+  parse_book(args[0]->getString(), tick, &s.xbid, &s.xask);
+  parse_book(args[1]->getString(), tick, &s.ybid, &s.yask);
+  consolidate_side(s.xbid, true);
+  consolidate_side(s.xask, false);
+  consolidate_side(s.ybid, true);
+  consolidate_side(s.yask, false);
+
+  s.bid.resize(min<size_t>(s.xbid.size() + s.ybid.size(), depth));
+  s.ask.resize(min<size_t>(s.xask.size() + s.yask.size(), depth));
+  uint32_t nbid = merge_side(s.xbid.data(), s.xbid.size(), s.ybid.data(), s.ybid.size(),
+                             true, depth, s.bid.data());
+  uint32_t nask = merge_side(s.xask.data(), s.xask.size(), s.yask.data(), s.yask.size(),
+                             false, depth, s.ask.data());
+  format_book(s.text, s.bid.data(), nbid, s.ask.data(), nask, tick);
+  res->setString(&s.text[0]);
+}
+
+/*
+ * @brief Consolidate two financial market order book strings. This assumes a
+ * very special formatting of each string:
+ *
+ * bid_price_1, bid_size_1, bid_price_2, bid_size_2, ..., bid_price_m, bid_size_m |
+ * ask_price_1, ask_size_1, ask_price_2, ask_size_2, ..., ask_price_n, ask_size_n
+ *
+ * (note that bid and ask sides are separated by a vertical pipe character).
+ * @param x (string) A string order book representation.
+ * @param y (string) A string order book representation.
+ * @param depth (uint32) The maximum output book depth
+ * @param tick (double) Optional price tick size, prices are rounded to the
+ * nearest tick (default 0.001). It must be positive and finite.
+ * @returns A string representation of the consolidated book, limited to at
+ * most the indicated depth, with prices written to as many decimals as the
+ * tick has, and at least three.
+ */
+static void
+book(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  consolidate_books(args, res, BOOK_DEFAULT_TICK);
+}
+
+static void
+book_tick(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  consolidate_books(args, res, args[3]->getDouble());
+}
+
+/* ***************************************************************************
+ *                          The binary book type
+ *
+ * See book.h for the layout of a binary book value.
+ * ***************************************************************************
+ */
+
+/* A read-only view of a binary book value */
+struct book_view
+{
+  double tick;
+  const book_level *bid;
+  const book_level *ask;
+  uint32_t nbid;
+  uint32_t nask;
+  uint32_t depth;
+
+  book_view(const void *data)
+  {
+    const book_header *h = (const book_header *) data;
+    tick  = h->tick;
+    nbid  = h->nbid;
+    nask  = h->nask;
+    depth = h->depth;
+    bid   = (const book_level *) (h + 1);
+    ask   = bid + nbid;
+  }
+
+  book_view(const Value *v): book_view(v->data()) {}
+
+/* The size in bytes of the viewed book value */
+  size_t size() const
+  {
+    return sizeof(book_header) + (nbid + nask) * sizeof(book_level);
+  }
+};
+
+/* Scratch space for building a book value with up to nlevels levels */
+static book_header *
+book_buffer(book_scratch &s, size_t nlevels)
+{
+  s.value.resize(sizeof(book_header) + nlevels * sizeof(book_level));
+  memset(&s.value[0], 0, sizeof(book_header));
+  return (book_header *) &s.value[0];
+}
+
+static void
+set_book(book_scratch &s, Value *res)
+{
+  book_header *h = (book_header *) &s.value[0];
+  res->setData(h, sizeof(book_header) + (h->nbid + h->nask) * sizeof(book_level));
+}
+
+/*
+ * @brief Consolidate two binary order books.
+ * @param x (book) A binary order book.
+ * @param y (book) A binary order book with the same tick size.
+ * @param depth (uint32) The maximum output book depth
+ * @returns The consolidated book, limited to at most the indicated depth
+ * on each side.
+ */
+static void
+binary_book(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_view x(args[0]);
+  book_view y(args[1]);
+  uint32_t depth = (uint32_t)args[2]->getUint32();
+  if(x.tick != y.tick)
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_TICK);
+  }
+
+  book_scratch &s = scratch();
+  book_header *h = book_buffer(s, min(x.nbid + y.nbid, depth) + min(x.nask + y.nask, depth));
+  book_level *level = (book_level *) (h + 1);
+  h->tick = x.tick;
+  h->depth = min(depth, min(x.depth, y.depth));
+  h->nbid = merge_side(x.bid, x.nbid, y.bid, y.nbid, true, depth, level);
+  h->nask = merge_side(x.ask, x.nask, y.ask, y.nask, false, depth, level + h->nbid);
+  set_book(s, res);
+}
+
+static void
+parse_binary_book(const char *x, double tick, Value *res)
+{
+  book_scratch &s = scratch();
+  parse_book(x, tick, &s.xbid, &s.xask);
+  consolidate_side(s.xbid, true);
+  consolidate_side(s.xask, false);
+  book_header *h = book_buffer(s, s.xbid.size() + s.xask.size());
+  book_level *level = (book_level *) (h + 1);
+  h->tick = tick;
+  h->depth = BOOK_UNLIMITED_DEPTH;
+  h->nbid = s.xbid.size();
+  h->nask = s.xask.size();
+  copy(s.xbid.begin(), s.xbid.end(), level);
+  copy(s.xask.begin(), s.xask.end(), level + h->nbid);
+  set_book(s, res);
+}
+
+/*
+ * @brief Convert a string order book into the binary book type.
+ * @param x (string) A string order book representation.
+ * @param tick (double) Optional price tick size (default 0.001), positive
+ * and finite
+ * @returns The binary book.
+ */
+static void
+string2book(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  parse_binary_book(args[0]->getString(), BOOK_DEFAULT_TICK, res);
+}
+
+static void
+string2book_tick(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  parse_binary_book(args[0]->getString(), args[1]->getDouble(), res);
+}
+
+/*
+ * @brief Convert a binary book to the string book format.
+ * @param x (book) A binary book.
+ * @returns A string representation of the book.
+ */
+static void
+book2string(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  book_view x(args[0]);
+  book_scratch &s = scratch();
+  format_book(s.text, x.bid, x.nbid, x.ask, x.nask, x.tick);
+  res->setString(&s.text[0]);
+}
+
+/*
+ * @brief Limit a binary book to a depth, and record the depth in the book
+ * for the book_merge aggregate.
+ * @param x (book) A binary book.
+ * @param depth (uint32) The maximum book depth
+ * @returns The book truncated to at most depth levels on each side.
+ */
+static void
+book_depth(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_view x(args[0]);
+  uint32_t depth = (uint32_t)args[1]->getUint32();
+  book_scratch &s = scratch();
+  book_header *h = book_buffer(s, min(x.nbid, depth) + min(x.nask, depth));
+  book_level *level = (book_level *) (h + 1);
+  h->tick  = x.tick;
+  h->depth = min(x.depth, depth);
+  h->nbid  = min(x.nbid, depth);
+  h->nask  = min(x.nask, depth);
+  copy(x.bid, x.bid + h->nbid, level);
+  copy(x.ask, x.ask + h->nask, level + h->nbid);
+  set_book(s, res);
+}
+
+/* ***************************************************************************
+ *                            Book analytics
+ *
+ * These work on a single book, string or binary, without merging or
+ * formatting anything. On strings, the top of book functions keep just the
+ * best price seen on each side, and the depth functions parse the string
+ * once and sort only the sides they need. String prices are used as parsed,
+ * without tick rounding.
+ * ***************************************************************************
+ */
+
+/* A price level of a book string, with the price as parsed */
+struct book_quote
+{
+  double price;
+  double size;
+};
+
+/* Find the best bid and ask prices of a book string, returning false if
+ * either side is empty. The levels of a side may be listed in any order, so
+ * both sides are scanned in full.
+ */
+static bool
+string_top(const char *x, double *bid, double *ask)
+{
+  const char *b, *b_end, *a, *a_end;
+  split_book(x, &b, &b_end, &a, &a_end);
+  *bid = -INFINITY;
+  *ask = INFINITY;
+  scan_side(b, b_end, [bid](double price, double) { if(price > *bid) *bid = price; });
+  scan_side(a, a_end, [ask](double price, double) { if(price < *ask) *ask = price; });
+  return *bid != -INFINITY && *ask != INFINITY;
+}
+
+/* Find the best bid and ask prices of a binary book, returning false if
+ * either side is empty.
+ */
+static bool
+binary_top(const Value *v, double *bid, double *ask)
+{
+  book_view x(v);
+  if(x.nbid == 0 || x.nask == 0) return false;
+  *bid = x.bid[0].price * x.tick;
+  *ask = x.ask[0].price * x.tick;
+  return true;
+}
+
+/* Parse the side of a book string in [p, end) into side, sorted best price
+ * first with unique prices.
+ */
+static void
+quote_side(const char *p, const char *end, bool bid, vector<book_quote> &side)
+{
+  side.clear();
+  scan_side(p, end, [&side](double price, double size)
+  {
+    book_quote q = {price, size};
+    side.push_back(q);
+  });
+  consolidate_side(side, bid);
+}
+
+/* Parse one side of a book string into a scratch vector of levels sorted
+ * best price first with unique prices.
+ */
+static vector<book_quote> &
+string_side(const char *x, bool bid)
+{
+  static thread_local vector<book_quote> side;
+  const char *b, *b_end, *a, *a_end;
+  split_book(x, &b, &b_end, &a, &a_end);
+  if(bid) quote_side(b, b_end, true, side);
+  else    quote_side(a, a_end, false, side);
+  return side;
+}
+
+/* The total size of the best depth levels of a side */
+template<class L>
+static double
+side_volume(const L *level, size_t n, uint32_t depth)
+{
+  double v = 0;
+  for(size_t j = 0; j < n && j < depth; ++j) v += level[j].size;
+  return v;
+}
+
+/* The average price paid to fill qty from a side sorted best first, or the
+ * average over the whole side if it holds less than qty. Prices are
+ * multiplied by scale. NaN if the side is empty.
+ */
+template<class L>
+static double
+side_vwap(const L *level, size_t n, double qty, double scale)
+{
+  double filled = 0, notional = 0;
+  for(size_t j = 0; j < n && filled < qty; ++j)
+  {
+    double take = min(level[j].size, qty - filled);
+    notional += take * level[j].price * scale;
+    filled   += take;
+  }
+  return filled > 0 ? notional / filled : NAN;
+}
+
+/* Decide the side named by a book_vwap argument, true for bids */
+static bool
+book_side(const Value *v)
+{
+  const char *side = v->getString();
+  if(strcasecmp(side, "bid") == 0) return true;
+  if(strcasecmp(side, "ask") == 0) return false;
+  throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_SIDE);
+}
+
+/*
+ * @brief The mid price of a book, halfway between the best bid and ask.
+ * @param x (string or book) An order book.
+ * @returns The mid price, or null if either side of the book is empty.
+ */
+static void
+book_mid(const Value **args, Value *res, void*)
+{
+  double bid, ask;
+  if(args[0]->isNull() || !string_top(args[0]->getString(), &bid, &ask))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble((bid + ask) / 2);
+}
+
+static void
+binary_book_mid(const Value **args, Value *res, void*)
+{
+  double bid, ask;
+  if(args[0]->isNull() || !binary_top(args[0], &bid, &ask))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble((bid + ask) / 2);
+}
+
+/*
+ * @brief The spread of a book, the best ask less the best bid.
+ * @param x (string or book) An order book.
+ * @returns The spread, or null if either side of the book is empty.
+ */
+static void
+book_spread(const Value **args, Value *res, void*)
+{
+  double bid, ask;
+  if(args[0]->isNull() || !string_top(args[0]->getString(), &bid, &ask))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble(ask - bid);
+}
+
+static void
+binary_book_spread(const Value **args, Value *res, void*)
+{
+  double bid, ask;
+  if(args[0]->isNull() || !binary_top(args[0], &bid, &ask))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble(ask - bid);
+}
+
+/*
+ * @brief The order imbalance of the top levels of a book.
+ * @param x (string or book) An order book.
+ * @param depth (uint32) The number of levels of each side to count.
+ * @returns (bid size - ask size) / (bid size + ask size) over the best
+ * depth levels of each side, between -1 and 1, or null if there is no size.
+ */
+static void
+book_imbalance(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  uint32_t depth = (uint32_t)args[1]->getUint32();
+  static thread_local vector<book_quote> bid, ask;
+  const char *bs, *b_end, *as, *a_end;
+  split_book(args[0]->getString(), &bs, &b_end, &as, &a_end);
+  quote_side(bs, b_end, true, bid);
+  quote_side(as, a_end, false, ask);
+  double b = side_volume(bid.data(), bid.size(), depth);
+  double a = side_volume(ask.data(), ask.size(), depth);
+  if(a + b == 0)
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble((b - a) / (b + a));
+}
+
+static void
+binary_book_imbalance(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_view x(args[0]);
+  uint32_t depth = (uint32_t)args[1]->getUint32();
+  double b = side_volume(x.bid, x.nbid, depth);
+  double a = side_volume(x.ask, x.nask, depth);
+  if(a + b == 0)
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble((b - a) / (b + a));
+}
+
+/*
+ * @brief The volume-weighted average price of filling a quantity from one
+ * side of a book, walking the levels from the best price.
+ * @param x (string or book) An order book.
+ * @param side (string) 'bid' or 'ask'.
+ * @param qty (double) The quantity to fill.
+ * @returns The VWAP of the first qty units on the side, or of the whole
+ * side if it holds less than qty, or null if the side is empty.
+ */
+static void
+book_vwap(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  vector<book_quote> &side = string_side(args[0]->getString(), book_side(args[1]));
+  double v = side_vwap(side.data(), side.size(), args[2]->getDouble(), 1.0);
+  if(isnan(v))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble(v);
+}
+
+static void
+binary_book_vwap(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_view x(args[0]);
+  bool bid = book_side(args[1]);
+  double v = bid ? side_vwap(x.bid, x.nbid, args[2]->getDouble(), x.tick)
+                 : side_vwap(x.ask, x.nask, args[2]->getDouble(), x.tick);
+  if(isnan(v))
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble(v);
+}
+
+/* ***************************************************************************
+ *                           Book deltas
+ *
+ * A book_delta value is a book_delta_header followed by the changed bid
+ * levels and then the changed ask levels, each side best price first. A
+ * changed level holds the new size of its price, or NaN when the price
+ * level was removed. A keyframe delta holds a whole book instead, and
+ * replaces all the levels of the book it is applied to.
+ *
+ * Consecutive snapshots usually differ in a level or two, so a delta is a
+ * few dozen bytes where the book is hundreds or thousands. The sequence
+ * number orders deltas for the book_rebuild aggregate.
+ * ***************************************************************************
+ */
+#define BOOK_DELTA_KEYFRAME 1
+
+struct book_delta_header
+{
+  double   tick;
+  int64_t  seq;
+  uint32_t depth;
+  uint32_t flags;
+  uint32_t nbid;
+  uint32_t nask;
+};
+
+/* A read-only view of a book_delta value */
+struct book_delta_view
+{
+  const book_delta_header *h;
+  const book_level *bid;
+  const book_level *ask;
+
+  book_delta_view(const Value *v)
+  {
+    h   = (const book_delta_header *) v->data();
+    bid = (const book_level *) (h + 1);
+    ask = bid + h->nbid;
+  }
+};
+
+static inline bool
+better(bool bid, int64_t a, int64_t b)
+{
+  return bid ? a > b : a < b;
+}
+
+/* The changes that turn side a into side b, both sorted best first */
+static uint32_t
+diff_side(const book_level *a, uint32_t na,
+          const book_level *b, uint32_t nb,
+          bool bid, book_level *out)
+{
+  uint32_t i = 0, j = 0, k = 0;
+  while(i < na || j < nb)
+  {
+    if(j == nb || (i < na && better(bid, a[i].price, b[j].price)))
+    {
+      out[k].price = a[i++].price;
+      out[k++].size = NAN;
+    } else if(i == na || a[i].price != b[j].price)
+    {
+      out[k++] = b[j++];
+    } else
+    {
+      if(a[i].size != b[j].size) out[k++] = b[j];
+      ++i;
+      ++j;
+    }
+  }
+  return k;
+}
+
+/* Apply the changes d to side a, both sorted best first, writing at most
+ * depth levels to out.
+ */
+static uint32_t
+apply_side(const book_level *a, uint32_t na,
+           const book_level *d, uint32_t nd,
+           bool bid, uint32_t depth, book_level *out)
+{
+  uint32_t i = 0, j = 0, k = 0;
+  while(k < depth && (i < na || j < nd))
+  {
+    if(j == nd || (i < na && better(bid, a[i].price, d[j].price)))
+    {
+      out[k++] = a[i++];
+    } else
+    {
+      if(!isnan(d[j].size)) out[k++] = d[j];
+      if(i < na && a[i].price == d[j].price) ++i;
+      ++j;
+    }
+  }
+  return k;
+}
+
+/* Scratch space for building a book_delta value with up to nlevels levels */
+static book_delta_header *
+delta_buffer(book_scratch &s, size_t nlevels)
+{
+  s.value.resize(sizeof(book_delta_header) + nlevels * sizeof(book_level));
+  memset(&s.value[0], 0, sizeof(book_delta_header));
+  return (book_delta_header *) &s.value[0];
+}
+
+static void
+set_delta(book_scratch &s, Value *res)
+{
+  book_delta_header *h = (book_delta_header *) &s.value[0];
+  res->setData(h, sizeof(book_delta_header) + (h->nbid + h->nask) * sizeof(book_level));
+}
+
+static void
+diff_books(const Value *x, const Value *y, int64_t seq, Value *res)
+{
+  book_view cur(y);
+  book_header empty = {cur.tick, 0, 0, 0, 0};
+  Value none;
+  none.setData(&empty, sizeof(empty));
+  book_view prev(x->isNull() ? &none : x);
+  if(prev.tick != cur.tick)
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_TICK);
+  }
+  book_scratch &s = scratch();
+  book_delta_header *h = delta_buffer(s, prev.nbid + cur.nbid + prev.nask + cur.nask);
+  book_level *level = (book_level *) (h + 1);
+  h->tick  = cur.tick;
+  h->seq   = seq;
+  h->depth = cur.depth;
+  h->nbid  = diff_side(prev.bid, prev.nbid, cur.bid, cur.nbid, true, level);
+  h->nask  = diff_side(prev.ask, prev.nask, cur.ask, cur.nask, false, level + h->nbid);
+  set_delta(s, res);
+}
+
+/*
+ * @brief The changes between two binary books.
+ * @param prev (book) The earlier book, null for an empty book.
+ * @param cur (book) The later book.
+ * @param seq (int64) Optional sequence number of cur (default 0), used by
+ * the book_rebuild aggregate.
+ * @returns A book_delta that book_apply turns prev into cur with.
+ */
+static void
+book_diff(const Value **args, Value *res, void*)
+{
+  if(args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  diff_books(args[0], args[1], 0, res);
+}
+
+static void
+book_diff_seq(const Value **args, Value *res, void*)
+{
+  if(args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  diff_books(args[0], args[1], args[2]->getInt64(), res);
+}
+
+/*
+ * @brief A keyframe delta holding a whole book.
+ * @param x (book) A binary book.
+ * @param seq (int64) The sequence number of the book.
+ * @returns A book_delta that replaces any book it is applied to with x.
+ */
+static void
+book_keyframe(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_view x(args[0]);
+  book_scratch &s = scratch();
+  book_delta_header *h = delta_buffer(s, x.nbid + x.nask);
+  book_level *level = (book_level *) (h + 1);
+  h->tick  = x.tick;
+  h->seq   = args[1]->getInt64();
+  h->depth = x.depth;
+  h->flags = BOOK_DELTA_KEYFRAME;
+  h->nbid  = x.nbid;
+  h->nask  = x.nask;
+  copy(x.bid, x.bid + x.nbid, level);
+  copy(x.ask, x.ask + x.nask, level + x.nbid);
+  set_delta(s, res);
+}
+
+/*
+ * @brief Apply a book_delta to a binary book.
+ * @param prev (book) A binary book, null for an empty book.
+ * @param delta (book_delta) Changes from book_diff or a keyframe.
+ * @returns The changed book.
+ */
+static void
+book_apply(const Value **args, Value *res, void*)
+{
+  if(args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_delta_view d(args[1]);
+  uint32_t nbid = 0, nask = 0;
+  const book_level *bid = NULL, *ask = NULL;
+  if(!args[0]->isNull() && !(d.h->flags & BOOK_DELTA_KEYFRAME))
+  {
+    book_view prev(args[0]);
+    if(prev.tick != d.h->tick)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_TICK);
+    }
+    bid  = prev.bid;
+    ask  = prev.ask;
+    nbid = prev.nbid;
+    nask = prev.nask;
+  }
+  book_scratch &s = scratch();
+  book_header *h = book_buffer(s, min(nbid + d.h->nbid, d.h->depth) + min(nask + d.h->nask, d.h->depth));
+  book_level *level = (book_level *) (h + 1);
+  h->tick  = d.h->tick;
+  h->depth = d.h->depth;
+  h->nbid  = apply_side(bid, nbid, d.bid, d.h->nbid, true, d.h->depth, level);
+  h->nask  = apply_side(ask, nask, d.ask, d.h->nask, false, d.h->depth, level + h->nbid);
+  set_book(s, res);
+}
+
+/* ***************************************************************************
+ *                      Books from numeric attributes
+ *
+ * SciDB functions have fixed arguments, so book_pack is registered once for
+ * each number of levels per side, from 1 to 10.
+ * ***************************************************************************
+ */
+/* Build a binary book from n bid price/size pairs followed by n ask
+ * price/size pairs, skipping pairs with a null or NaN value.
+ */
+static void
+pack_book(const Value **args, size_t n, Value *res)
+{
+  book_scratch &s = scratch();
+  for(size_t j = 0; j < 2 * n; ++j)
+  {
+    const Value *price = args[2 * j], *size = args[2 * j + 1];
+    if(price->isNull() || size->isNull()) continue;
+    double p = price->getDouble() / BOOK_DEFAULT_TICK;
+    if(!(fabs(p) < 9e18) || isnan(size->getDouble())) continue;
+    book_level level = {llround(p), size->getDouble()};
+    (j < n ? s.xbid : s.xask).push_back(level);
+  }
+  consolidate_side(s.xbid, true);
+  consolidate_side(s.xask, false);
+  book_header *h = book_buffer(s, s.xbid.size() + s.xask.size());
+  book_level *level = (book_level *) (h + 1);
+  h->tick  = BOOK_DEFAULT_TICK;
+  h->depth = BOOK_UNLIMITED_DEPTH;
+  h->nbid  = s.xbid.size();
+  h->nask  = s.xask.size();
+  copy(s.xbid.begin(), s.xbid.end(), level);
+  copy(s.xask.begin(), s.xask.end(), level + h->nbid);
+  set_book(s, res);
+}
+
+/*
+ * @brief Build a binary book directly from numeric level attributes.
+ * @param bid_price_1, bid_size_1, ..., bid_price_n, bid_size_n (double)
+ * @param ask_price_1, ask_size_1, ..., ask_price_n, ask_size_n (double)
+ * @returns The binary book, with the default tick size. Levels with a null
+ * price or size are left out.
+ */
+#define BOOK_PACK(n) \
+static void \
+book_pack##n(const Value **args, Value *res, void*) \
+{ \
+  pack_book(args, n, res); \
+}
+BOOK_PACK(1)
+BOOK_PACK(2)
+BOOK_PACK(3)
+BOOK_PACK(4)
+BOOK_PACK(5)
+BOOK_PACK(6)
+BOOK_PACK(7)
+BOOK_PACK(8)
+BOOK_PACK(9)
+BOOK_PACK(10)
+
+/* The argument types of book_pack with n levels per side */
+static vector<TypeId>
+book_pack_args(size_t n)
+{
+  return vector<TypeId>(4 * n, TID_DOUBLE);
+}
+
+/*
+ * @brief One field of one level of a binary book.
+ * @param x (book) A binary book.
+ * @param field (string) One of 'bid_price', 'bid_size', 'ask_price' or
+ * 'ask_size'.
+ * @param i (uint32) The level, 1 for the best price of the side.
+ * @returns The field, or null if the side has fewer than i levels.
+ */
+static void
+book_level_field(const Value **args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  book_view x(args[0]);
+  const char *field = args[1]->getString();
+  uint32_t i = (uint32_t)args[2]->getUint32();
+  bool bid;
+  if(strncasecmp(field, "bid_", 4) == 0) bid = true;
+  else if(strncasecmp(field, "ask_", 4) == 0) bid = false;
+  else throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_FIELD);
+  bool price = strcasecmp(field + 4, "price") == 0;
+  if(!price && strcasecmp(field + 4, "size") != 0)
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_FIELD);
+  }
+  if(i < 1 || i > (bid ? x.nbid : x.nask))
+  {
+    res->setNull(0);
+    return;
+  }
+  const book_level &l = (bid ? x.bid : x.ask)[i - 1];
+  res->setDouble(price ? l.price * x.tick : l.size);
+}
+
+REGISTER_TYPE(book, 0);
+REGISTER_FUNCTION(book, list_of("string")("string")("uint32"), "string", book);
+REGISTER_FUNCTION(book, list_of("string")("string")("uint32")("double"), "string", book_tick);
+REGISTER_FUNCTION(book, list_of("book")("book")("uint32"), "book", binary_book);
+REGISTER_FUNCTION(book, list_of("string"), "book", string2book);
+REGISTER_FUNCTION(book, list_of("string")("double"), "book", string2book_tick);
+REGISTER_FUNCTION(book_depth, list_of("book")("uint32"), "book", book_depth);
+REGISTER_FUNCTION(book_mid, list_of("string"), "double", book_mid);
+REGISTER_FUNCTION(book_mid, list_of("book"), "double", binary_book_mid);
+REGISTER_FUNCTION(book_spread, list_of("string"), "double", book_spread);
+REGISTER_FUNCTION(book_spread, list_of("book"), "double", binary_book_spread);
+REGISTER_FUNCTION(book_imbalance, list_of("string")("uint32"), "double", book_imbalance);
+REGISTER_FUNCTION(book_imbalance, list_of("book")("uint32"), "double", binary_book_imbalance);
+REGISTER_FUNCTION(book_vwap, list_of("string")("string")("double"), "double", book_vwap);
+REGISTER_FUNCTION(book_vwap, list_of("book")("string")("double"), "double", binary_book_vwap);
+REGISTER_FUNCTION(book_pack, book_pack_args(1), "book", book_pack1);
+REGISTER_FUNCTION(book_pack, book_pack_args(2), "book", book_pack2);
+REGISTER_FUNCTION(book_pack, book_pack_args(3), "book", book_pack3);
+REGISTER_FUNCTION(book_pack, book_pack_args(4), "book", book_pack4);
+REGISTER_FUNCTION(book_pack, book_pack_args(5), "book", book_pack5);
+REGISTER_FUNCTION(book_pack, book_pack_args(6), "book", book_pack6);
+REGISTER_FUNCTION(book_pack, book_pack_args(7), "book", book_pack7);
+REGISTER_FUNCTION(book_pack, book_pack_args(8), "book", book_pack8);
+REGISTER_FUNCTION(book_pack, book_pack_args(9), "book", book_pack9);
+REGISTER_FUNCTION(book_pack, book_pack_args(10), "book", book_pack10);
+REGISTER_FUNCTION(book_level, list_of("book")("string")("uint32"), "double", book_level_field);
+REGISTER_TYPE(book_delta, 0);
+REGISTER_FUNCTION(book_diff, list_of("book")("book"), "book_delta", book_diff);
+REGISTER_FUNCTION(book_diff, list_of("book")("book")("int64"), "book_delta", book_diff_seq);
+REGISTER_FUNCTION(book_keyframe, list_of("book")("int64"), "book_delta", book_keyframe);
+REGISTER_FUNCTION(book_apply, list_of("book")("book_delta"), "book", book_apply);
+REGISTER_CONVERTER(string, book, EXPLICIT_CONVERSION_COST, string2book);
+REGISTER_CONVERTER(book, string, EXPLICIT_CONVERSION_COST, book2string);
+
+/* ***************************************************************************
+ *                        The book_merge aggregate
+ *
+ * The aggregate state is a run of binary books laid end to end. Inputs and
+ * partial states from other instances are appended as they are, and once
+ * BOOK_MERGE_FANIN books have piled up they are compacted into one with a
+ * k-way merge limited to the smallest depth recorded in any of them. So the
+ * state never holds more than BOOK_MERGE_FANIN depth-limited books, and each
+ * level is merged about once instead of once per input as with chained book
+ * calls.
+ * ***************************************************************************
+ */
+#define BOOK_MERGE_FANIN 32
+
+/* A position in one side of one book, for the k-way merge */
+struct book_cursor
+{
+  const book_level *level;
+  const book_level *end;
+};
+
+/* Heap order putting the cursor at the best price on top */
+struct cursor_order
+{
+  bool bid;
+  cursor_order(bool b): bid(b) {}
+  bool operator()(book_cursor const& a, book_cursor const& b) const
+  {
+    return bid ? a.level->price < b.level->price : a.level->price > b.level->price;
+  }
+};
+
+/* Merge the book sides under the cursors, summing the sizes of equal prices
+ * and stopping once depth levels have been written. Returns the number of
+ * levels written to out.
+ */
+static uint32_t
+kway_merge_side(vector<book_cursor> &heap, bool bid, uint32_t depth, book_level *out)
+{
+  cursor_order order(bid);
+  uint32_t k = 0;
+  make_heap(heap.begin(), heap.end(), order);
+  while(!heap.empty())
+  {
+    pop_heap(heap.begin(), heap.end(), order);
+    book_cursor &c = heap.back();
+    if(k > 0 && out[k - 1].price == c.level->price)
+    {
+      out[k - 1].size += c.level->size;
+    } else
+    {
+      if(k == depth) break;
+      out[k++] = *c.level;
+    }
+    if(++c.level < c.end) push_heap(heap.begin(), heap.end(), order);
+    else heap.pop_back();
+  }
+  return k;
+}
+
+/* Split a run of binary books laid end to end into views */
+static void
+book_run(const char *p, size_t size, vector<book_view> &books)
+{
+  const char *end = p + size;
+  books.clear();
+  while(p < end)
+  {
+    books.push_back(book_view(p));
+    p += books.back().size();
+  }
+}
+
+/* Merge a run of books into a single book in out */
+static void
+merge_books(vector<book_view> const& books, vector<char> &out)
+{
+  vector<book_cursor> bid, ask;
+  uint32_t depth = BOOK_UNLIMITED_DEPTH;
+  size_t nbid = 0, nask = 0;
+  for(size_t j = 0; j < books.size(); ++j)
+  {
+    book_view const& b = books[j];
+    if(b.tick != books[0].tick)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_TICK);
+    }
+    depth = min(depth, b.depth);
+    nbid += b.nbid;
+    nask += b.nask;
+    if(b.nbid > 0)
+    {
+      book_cursor c = {b.bid, b.bid + b.nbid};
+      bid.push_back(c);
+    }
+    if(b.nask > 0)
+    {
+      book_cursor c = {b.ask, b.ask + b.nask};
+      ask.push_back(c);
+    }
+  }
+  nbid = min<size_t>(nbid, depth);
+  nask = min<size_t>(nask, depth);
+  out.resize(sizeof(book_header) + (nbid + nask) * sizeof(book_level));
+  book_header *h = (book_header *) &out[0];
+  book_level *level = (book_level *) (h + 1);
+  h->tick  = books.empty() ? BOOK_DEFAULT_TICK : books[0].tick;
+  h->depth = depth;
+  h->reserved = 0;
+  h->nbid  = kway_merge_side(bid, true, depth, level);
+  h->nask  = kway_merge_side(ask, false, depth, level + h->nbid);
+  out.resize(sizeof(book_header) + (h->nbid + h->nask) * sizeof(book_level));
+}
+
+/* Per-thread scratch space for the book_merge aggregate */
+struct book_merge_scratch
+{
+  vector<char> run;
+  vector<char> merged;
+  vector<book_view> books;
+};
+
+static book_merge_scratch &
+merge_scratch()
+{
+  static thread_local book_merge_scratch s;
+  return s;
+}
+
+class BookMergeAggregate : public Aggregate
+{
+private:
+/* Append a run of books to a state, compacting the state when it gets to
+ * BOOK_MERGE_FANIN books.
+ */
+  void append(Value& state, const void *data, size_t size)
+  {
+    book_merge_scratch &s = merge_scratch();
+    s.run.resize(state.size() + size);
+    if(state.size() > 0) memcpy(&s.run[0], state.data(), state.size());
+    memcpy(&s.run[state.size()], data, size);
+    book_run(&s.run[0], s.run.size(), s.books);
+    if(s.books.size() >= BOOK_MERGE_FANIN)
+    {
+      merge_books(s.books, s.merged);
+      state.setData(&s.merged[0], s.merged.size());
+      return;
+    }
+    state.setData(&s.run[0], s.run.size());
+  }
+
+public:
+  BookMergeAggregate(const string& name, Type const& aggregateType):
+    Aggregate(name, aggregateType, aggregateType)
+  {}
+
+  AggregatePtr clone() const
+  {
+    return AggregatePtr(new BookMergeAggregate(getName(), getAggregateType()));
+  }
+
+  AggregatePtr clone(Type const& aggregateType) const
+  {
+    return AggregatePtr(new BookMergeAggregate(getName(), aggregateType));
+  }
+
+  Type getStateType() const
+  {
+    return TypeLibrary::getType(TID_BINARY);
+  }
+
+  bool ignoreNulls() const
+  {
+    return true;
+  }
+
+  void initializeState(Value& state)
+  {
+    state.setData(NULL, 0);
+  }
+
+  void accumulate(Value& state, Value const& input)
+  {
+    append(state, input.data(), input.size());
+  }
+
+  void merge(Value& dstState, Value const& srcState)
+  {
+    if(srcState.isNull() || srcState.size() == 0) return;
+    append(dstState, srcState.data(), srcState.size());
+  }
+
+  void finalResult(Value& result, Value const& state)
+  {
+    if(state.isNull() || state.size() == 0)
+    {
+      result.setNull(0);
+      return;
+    }
+    book_merge_scratch &s = merge_scratch();
+    book_run((const char *) state.data(), state.size(), s.books);
+    merge_books(s.books, s.merged);
+    result.setData(&s.merged[0], s.merged.size());
+  }
+};
+
+/* ***************************************************************************
+ *                        The book_rebuild aggregate
+ *
+ * Rebuilds a book from its latest keyframe and the deltas after it, in any
+ * order. Every delta records all the levels that changed at its sequence
+ * number, so the final size of a price level is the one written by the
+ * delta with the highest sequence number that touched it, or the keyframe's
+ * if none did. The state keeps, for each price seen on each side, the size
+ * (NaN once removed) and the sequence number that wrote it, and merges
+ * states by keeping the latest writer of each price.
+ * ***************************************************************************
+ */
+struct rebuild_header
+{
+  double   tick;
+  int64_t  keyframe;   // sequence number of the latest keyframe
+  int64_t  last;       // the highest sequence number seen
+  uint32_t depth;      // depth of the delta with the highest sequence number
+  uint32_t nbid;
+  uint32_t nask;
+  uint32_t reserved;
+};
+
+struct stamped_level
+{
+  int64_t price;
+  double  size;
+  int64_t seq;
+};
+
+/* Merge two stamped sides sorted best first, keeping the latest writer of
+ * each price and dropping what the keyframe replaced.
+ */
+static uint32_t
+merge_stamped(const stamped_level *a, uint32_t na,
+              const stamped_level *b, uint32_t nb,
+              bool bid, int64_t keyframe, stamped_level *out)
+{
+  uint32_t i = 0, j = 0, k = 0;
+  while(i < na || j < nb)
+  {
+    stamped_level l;
+    if(j == nb || (i < na && better(bid, a[i].price, b[j].price)))
+    {
+      l = a[i++];
+    } else if(i == na || a[i].price != b[j].price)
+    {
+      l = b[j++];
+    } else
+    {
+      l = a[i].seq >= b[j].seq ? a[i] : b[j];
+      ++i;
+      ++j;
+    }
+    if(l.seq >= keyframe) out[k++] = l;
+  }
+  return k;
+}
+
+/* A read-only view of a book_rebuild state */
+struct rebuild_view
+{
+  const rebuild_header *h;
+  const stamped_level *bid;
+  const stamped_level *ask;
+
+  rebuild_view(const void *data)
+  {
+    h   = (const rebuild_header *) data;
+    bid = (const stamped_level *) (h + 1);
+    ask = bid + h->nbid;
+  }
+};
+
+/* Turn a book_delta into a book_rebuild state in buf */
+static void
+delta_state(Value const& v, vector<char> &buf)
+{
+  book_delta_view d(&v);
+  uint32_t n = d.h->nbid + d.h->nask;
+  buf.resize(sizeof(rebuild_header) + n * sizeof(stamped_level));
+  rebuild_header *h = (rebuild_header *) &buf[0];
+  stamped_level *level = (stamped_level *) (h + 1);
+  h->tick     = d.h->tick;
+  h->keyframe = (d.h->flags & BOOK_DELTA_KEYFRAME) ? d.h->seq : INT64_MIN;
+  h->last     = d.h->seq;
+  h->depth    = d.h->depth;
+  h->nbid     = d.h->nbid;
+  h->nask     = d.h->nask;
+  h->reserved = 0;
+  for(uint32_t j = 0; j < n; ++j)
+  {
+    level[j].price = d.bid[j].price;
+    level[j].size  = d.bid[j].size;
+    level[j].seq   = d.h->seq;
+  }
+}
+
+/* Merge two book_rebuild states into out */
+static void
+merge_states(rebuild_view const& a, rebuild_view const& b, vector<char> &out)
+{
+  if(a.h->tick != b.h->tick)
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_BOOK_TICK);
+  }
+  out.resize(sizeof(rebuild_header) +
+             (a.h->nbid + b.h->nbid + a.h->nask + b.h->nask) * sizeof(stamped_level));
+  rebuild_header *h = (rebuild_header *) &out[0];
+  stamped_level *level = (stamped_level *) (h + 1);
+  bool b_last = b.h->last > a.h->last;
+  h->tick     = a.h->tick;
+  h->keyframe = max(a.h->keyframe, b.h->keyframe);
+  h->last     = b_last ? b.h->last : a.h->last;
+  h->depth    = b_last ? b.h->depth : a.h->depth;
+  h->reserved = 0;
+  h->nbid = merge_stamped(a.bid, a.h->nbid, b.bid, b.h->nbid, true, h->keyframe, level);
+  h->nask = merge_stamped(a.ask, a.h->nask, b.ask, b.h->nask, false, h->keyframe, level + h->nbid);
+  out.resize(sizeof(rebuild_header) + (h->nbid + h->nask) * sizeof(stamped_level));
+}
+
+class BookRebuildAggregate : public Aggregate
+{
+private:
+  void mergeInto(Value& state, const void *src)
+  {
+    static thread_local vector<char> merged;
+    merge_states(rebuild_view(state.data()), rebuild_view(src), merged);
+    state.setData(&merged[0], merged.size());
+  }
+
+public:
+  BookRebuildAggregate(const string& name, Type const& aggregateType, Type const& resultType):
+    Aggregate(name, aggregateType, resultType)
+  {}
+
+  AggregatePtr clone() const
+  {
+    return AggregatePtr(new BookRebuildAggregate(getName(), getAggregateType(), getResultType()));
+  }
+
+  AggregatePtr clone(Type const& aggregateType) const
+  {
+    return AggregatePtr(new BookRebuildAggregate(getName(), aggregateType, getResultType()));
+  }
+
+  Type getStateType() const
+  {
+    return TypeLibrary::getType(TID_BINARY);
+  }
+
+  bool ignoreNulls() const
+  {
+    return true;
+  }
+
+  void initializeState(Value& state)
+  {
+    state.setNull(0);
+  }
+
+  void accumulate(Value& state, Value const& input)
+  {
+    static thread_local vector<char> buf;
+    delta_state(input, buf);
+    if(state.isNull()) state.setData(&buf[0], buf.size());
+    else mergeInto(state, &buf[0]);
+  }
+
+  void merge(Value& dstState, Value const& srcState)
+  {
+    if(srcState.isNull()) return;
+    if(dstState.isNull()) dstState = srcState;
+    else mergeInto(dstState, srcState.data());
+  }
+
+  void finalResult(Value& result, Value const& state)
+  {
+    if(state.isNull())
+    {
+      result.setNull(0);
+      return;
+    }
+    rebuild_view r(state.data());
+    if(r.h->keyframe == INT64_MIN)
+    {
+      result.setNull(0);
+      return;
+    }
+    book_scratch &s = scratch();
+    book_header *h = book_buffer(s, min(r.h->nbid, r.h->depth) + min(r.h->nask, r.h->depth));
+    book_level *level = (book_level *) (h + 1);
+    h->tick  = r.h->tick;
+    h->depth = r.h->depth;
+    for(uint32_t j = 0; j < r.h->nbid && h->nbid < r.h->depth; ++j)
+    {
+      if(isnan(r.bid[j].size)) continue;
+      level[h->nbid].price = r.bid[j].price;
+      level[h->nbid++].size = r.bid[j].size;
+    }
+    for(uint32_t j = 0; j < r.h->nask && h->nask < r.h->depth; ++j)
+    {
+      if(isnan(r.ask[j].size)) continue;
+      level[h->nbid + h->nask].price = r.ask[j].price;
+      level[h->nbid + h->nask++].size = r.ask[j].size;
+    }
+    set_book(s, &result);
+  }
+};
+
+static class book_aggregates
+{
+public:
+  book_aggregates()
+  {
+    AggregateLibrary::getInstance()->addAggregate(
+      AggregatePtr(new BookMergeAggregate("book_merge", TypeLibrary::getType("book"))), "superfunpack");
+    AggregateLibrary::getInstance()->addAggregate(
+      AggregatePtr(new BookRebuildAggregate("book_rebuild", TypeLibrary::getType("book_delta"),
+                                            TypeLibrary::getType("book"))), "superfunpack");
+  }
+} _book_aggregates;
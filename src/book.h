@@ -0,0 +1,59 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stdint.h>
+
+/* The binary order book representation shared by the book functions and
+ * the book_replay operator.
+ *
+ * A book value is a book_header followed by the bid levels, best (highest)
+ * price first, and then the ask levels, best (lowest) price first. Prices
+ * are in ticks of the size given in the header and are unique within each
+ * side. Books in this form merge without any parsing or formatting, and
+ * depth limits just truncate each side. The header also records the depth
+ * the book was limited to, which tells the book_merge aggregate how many
+ * levels it must keep.
+ */
+
+/* The tick size used when none is specified, matching the three decimal
+ * places of the string book output.
+ */
+#define BOOK_DEFAULT_TICK 0.001
+
+#define BOOK_UNLIMITED_DEPTH 0xFFFFFFFF
+
+/* One price level of an order book, the price in ticks. */
+struct book_level
+{
+  int64_t price;
+  double  size;
+};
+
+struct book_header
+{
+  double   tick;
+  uint32_t nbid;
+  uint32_t nask;
+  uint32_t depth;
+  uint32_t reserved;
+};
+
+#endif
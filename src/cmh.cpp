@@ -0,0 +1,414 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <boost/assign.hpp>
+#include <boost/math/special_functions/erf.hpp>
+
+#include "query/FunctionLibrary.h"
+#include "query/FunctionDescription.h"
+#include "query/Aggregate.h"
+
+using namespace std;
+using namespace scidb;
+using namespace boost::assign;
+
+/** @file cmh.cpp
+ *
+ * @brief The cmh type, the cmh aggregate, and their support functions.
+ *
+ * The Cochran-Mantel-Haenszel test and the Mantel-Haenszel common odds
+ * ratio of a stack of 2x2 tables, as R's mantelhaen.test. The cmh_stratum
+ * function makes the state of one table out of the x, m, n, k of the
+ * fishertest functions, and the cmh aggregate adds states up in any order,
+ * so the test over all strata comes out of a single distributed pass.
+ *
+ * @par Synopsis: cmh_stratum (double x, double m, double n, double k),
+ * cmh (cmh) aggregate, cmh_odds_ratio (cmh), cmh_conf_lower (cmh [, double
+ * conf_level]), cmh_conf_upper (cmh [, double conf_level]), cmh_statistic
+ * (cmh [, bool correct]), cmh_p_value (cmh [, string alternative, bool
+ * correct]), cmh_strata (cmh)
+ *
+ * @par Examples:
+ * <br>
+ * aggregate(apply(tables, s, cmh_stratum(x, m, n, k)), cmh(s) as s, gene)
+ **/
+
+/* The running state of the test, also the cmh type itself: sums over the
+ * strata, each with table
+ *
+ *         x      k - x      | k
+ *       m - x  n - k + x    |
+ *       ------------------
+ *         m      n          | t = m + n
+ *
+ * written a, b / c, d below. Strata with t < 2 add nothing.
+ */
+struct CMH
+{
+  double   delta;   // x - m k / t, the observed less the expected count
+  double   var;     // m n k (t - k) / (t^2 (t - 1)), its variance
+  double   r;       // a d / t, the Mantel-Haenszel numerator
+  double   s;       // b c / t, and denominator
+  double   pr;      // (a + d) a d / t^2, the Robins-Breslow-Greenland pieces
+  double   ps_qr;   // ((a + d) b c + (b + c) a d) / t^2
+  double   qs;      // (b + c) b c / t^2
+  uint64_t strata;
+};
+
+static void
+cmh_merge(CMH &dst, CMH const &src)
+{
+  dst.delta  += src.delta;
+  dst.var    += src.var;
+  dst.r      += src.r;
+  dst.s      += src.s;
+  dst.pr     += src.pr;
+  dst.ps_qr  += src.ps_qr;
+  dst.qs     += src.qs;
+  dst.strata += src.strata;
+}
+
+static inline CMH
+cmh_value(const Value *v)
+{
+  CMH c;
+  memcpy(&c, v->data(), sizeof(CMH));
+  return c;
+}
+
+/* The standard normal quantile */
+static inline double
+cmh_qnorm(double p)
+{
+  return -M_SQRT2 * boost::math::erfc_inv(2 * p);
+}
+
+/* The Mantel-Haenszel statistic, with R's continuity correction of 1/2
+ * unless the observed and expected counts are closer than that
+ */
+static double
+cmh_statistic(CMH const &c, bool correct)
+{
+  double yates = (correct && fabs(c.delta) >= 0.5) ? 0.5 : 0;
+  double d = fabs(c.delta) - yates;
+  return d * d / c.var;
+}
+
+static double
+cmh_p_value(CMH const &c, string const& a, bool correct)
+{
+  double x2 = cmh_statistic(c, correct);
+  if(a == "less" || a == "greater")
+  {
+    double z = (c.delta < 0 ? -1 : 1) * sqrt(x2);
+    if(a == "greater") z = -z;
+    return 0.5 * erfc(-z / M_SQRT2);
+  }
+// Default to two.sided: the upper tail of chi-squared with one degree of freedom
+  return erfc(sqrt(x2 / 2));
+}
+
+/* The Robins-Breslow-Greenland standard error of log(odds ratio) */
+static double
+cmh_sd(CMH const &c)
+{
+  return sqrt(c.pr / (2 * c.r * c.r) + c.ps_qr / (2 * c.r * c.s) + c.qs / (2 * c.s * c.s));
+}
+
+/*
+ * @brief The state of one stratum of the CMH test
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn.
+ * @returns A cmh value holding just this table, or null when x, m, n and k
+ * do not make a table.
+ */
+static void
+cmh_stratum(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  double a = x, b = k - x, c = m - x, d = n - k + x;
+  if(!(a >= 0 && b >= 0 && c >= 0 && d >= 0))
+  {
+    res->setNull(0);
+    return;
+  }
+  CMH s;
+  memset(&s, 0, sizeof(CMH));
+  double t = m + n;
+  if(t >= 2)
+  {
+    s.delta = x - m * k / t;
+    s.var = m * n * k * (t - k) / (t * t * (t - 1));
+    s.r = a * d / t;
+    s.s = b * c / t;
+    s.pr = (a + d) * s.r / t;
+    s.ps_qr = ((a + d) * s.s + (b + c) * s.r) / t;
+    s.qs = (b + c) * s.s / t;
+    s.strata = 1;
+  }
+  res->setData(&s, sizeof(CMH));
+}
+
+static void
+cmh_odds_ratio(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  CMH c = cmh_value(args[0]);
+  res->setDouble(c.r / c.s);
+}
+
+/* A bound of the two-sided confidence interval of the common odds ratio,
+ * the lower one for side -1 and the upper one for side 1, NaN unless
+ * 0 < conf_level < 1 like fisher_test
+ */
+static void
+cmh_conf(const Value *v, double conf_level, double side, Value *res)
+{
+  if(v->isNull())
+  {
+    res->setNull(v->getMissingReason());
+    return;
+  }
+  if(!(conf_level > 0 && conf_level < 1))
+  {
+    res->setDouble(NAN);
+    return;
+  }
+  CMH c = cmh_value(v);
+  res->setDouble(c.r / c.s * exp(-side * cmh_qnorm((1 - conf_level) / 2) * cmh_sd(c)));
+}
+
+static void
+superfun_cmh_conf_lower(const Value** args, Value *res, void*)
+{
+  if(args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  cmh_conf(args[0], args[1]->getDouble(), -1, res);
+}
+
+/* cmh_conf_lower of a 95% interval */
+static void
+superfun_cmh_conf_lower2(const Value** args, Value *res, void*)
+{
+  cmh_conf(args[0], 0.95, -1, res);
+}
+
+static void
+superfun_cmh_conf_upper(const Value** args, Value *res, void*)
+{
+  if(args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  cmh_conf(args[0], args[1]->getDouble(), 1, res);
+}
+
+static void
+superfun_cmh_conf_upper2(const Value** args, Value *res, void*)
+{
+  cmh_conf(args[0], 0.95, 1, res);
+}
+
+static void
+superfun_cmh_statistic(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble(cmh_statistic(cmh_value(args[0]), args[1]->getBool()));
+}
+
+/* cmh_statistic with the continuity correction */
+static void
+superfun_cmh_statistic2(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(cmh_statistic(cmh_value(args[0]), true));
+}
+
+/*
+ * @brief The p-value of the Cochran-Mantel-Haenszel test, as R's mantelhaen.test
+ * @param cmh (cmh) The state of the test over all strata
+ * @param alternative (string) one of {"less","greater","two.sided"}
+ * @param correct (bool) Whether to apply the continuity correction
+ * @returns The p-value for the common odds ratio of one
+ */
+static void
+superfun_cmh_p_value(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  res->setDouble(cmh_p_value(cmh_value(args[0]), args[1]->getString(), args[2]->getBool()));
+}
+
+/* cmh_p_value with a two-sided alternative and the continuity correction */
+static void
+superfun_cmh_p_value2(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(cmh_p_value(cmh_value(args[0]), "two.sided", true));
+}
+
+static void
+cmh_strata(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setInt64((int64_t) cmh_value(args[0]).strata);
+}
+
+/* Show a CMH test as p-value, odds ratio, lower, upper, as fisher does */
+static void
+cmh2string(const Value** args, Value *res, void*)
+{
+  char buf[128];
+  CMH c = cmh_value(args[0]);
+  double or_ = c.r / c.s, sd = cmh_sd(c), z = cmh_qnorm(0.025);
+  snprintf(buf, sizeof(buf), "%.15g, %.15g, %.15g, %.15g",
+           cmh_p_value(c, "two.sided", true), or_, or_ * exp(z * sd), or_ * exp(-z * sd));
+  res->setString(buf);
+}
+
+REGISTER_TYPE(cmh, sizeof(CMH));
+REGISTER_FUNCTION(cmh_stratum, list_of("double")("double")("double")("double"), "cmh", cmh_stratum);
+REGISTER_FUNCTION(cmh_odds_ratio, list_of("cmh"), "double", cmh_odds_ratio);
+REGISTER_FUNCTION(cmh_conf_lower, list_of("cmh")("double"), "double", superfun_cmh_conf_lower);
+REGISTER_FUNCTION(cmh_conf_lower, list_of("cmh"), "double", superfun_cmh_conf_lower2);
+REGISTER_FUNCTION(cmh_conf_upper, list_of("cmh")("double"), "double", superfun_cmh_conf_upper);
+REGISTER_FUNCTION(cmh_conf_upper, list_of("cmh"), "double", superfun_cmh_conf_upper2);
+REGISTER_FUNCTION(cmh_statistic, list_of("cmh")("bool"), "double", superfun_cmh_statistic);
+REGISTER_FUNCTION(cmh_statistic, list_of("cmh"), "double", superfun_cmh_statistic2);
+REGISTER_FUNCTION(cmh_p_value, list_of("cmh")("string")("bool"), "double", superfun_cmh_p_value);
+REGISTER_FUNCTION(cmh_p_value, list_of("cmh"), "double", superfun_cmh_p_value2);
+REGISTER_FUNCTION(cmh_strata, list_of("cmh"), "int64", cmh_strata);
+REGISTER_CONVERTER(cmh, string, EXPLICIT_CONVERSION_COST, cmh2string);
+
+/* The cmh aggregate: the state is itself a cmh value, and the sums add up
+ * the same way whether they come from inputs or from other instances.
+ */
+class CMHAggregate : public Aggregate
+{
+public:
+  CMHAggregate(const string& name, Type const& aggregateType):
+    Aggregate(name, aggregateType, aggregateType)
+  {}
+
+  AggregatePtr clone() const
+  {
+    return AggregatePtr(new CMHAggregate(getName(), getAggregateType()));
+  }
+
+  AggregatePtr clone(Type const& aggregateType) const
+  {
+    return AggregatePtr(new CMHAggregate(getName(), aggregateType));
+  }
+
+  Type getStateType() const
+  {
+    return getAggregateType();
+  }
+
+  bool ignoreNulls() const
+  {
+    return true;
+  }
+
+  void initializeState(Value& state)
+  {
+    CMH c;
+    memset(&c, 0, sizeof(CMH));
+    state.setData(&c, sizeof(CMH));
+  }
+
+  void accumulate(Value& state, Value const& input)
+  {
+    merge(state, input);
+  }
+
+  void merge(Value& dstState, Value const& srcState)
+  {
+    CMH dst = cmh_value(&dstState);
+    cmh_merge(dst, cmh_value(&srcState));
+    dstState.setData(&dst, sizeof(CMH));
+  }
+
+  void finalResult(Value& result, Value const& state)
+  {
+    if(state.isNull() || cmh_value(&state).strata == 0)
+    {
+      result.setNull(0);
+      return;
+    }
+    result = state;
+  }
+};
+
+static class cmh_aggregates
+{
+public:
+  cmh_aggregates()
+  {
+    AggregateLibrary::getInstance()->addAggregate(
+      AggregatePtr(new CMHAggregate("cmh", TypeLibrary::getType("cmh"))), "superfunpack");
+  }
+} _cmh_aggregates;
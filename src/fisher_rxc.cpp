@@ -0,0 +1,553 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/assign.hpp>
+
+#include "query/FunctionLibrary.h"
+#include "query/FunctionDescription.h"
+#include "system/ErrorsLibrary.h"
+
+#include "superfunpack.h"
+#include "R/fun.h"
+
+using namespace std;
+using namespace scidb;
+using namespace boost::assign;
+
+/** @file fisher_rxc.cpp
+ *
+ * @brief Fisher's exact test for r x c contingency tables.
+ *
+ * Small tables are tested exactly with a network algorithm, large ones by
+ * Monte Carlo over random tables with the same margins on request, as R's
+ * fisher.test does with simulate.p.value = TRUE. The tables are packed in a string,
+ * rows separated by semicolons and counts by commas, '3,1,0;1,3,2'.
+ *
+ * @par Synopsis: fishertest_rxc_p_value (string table),
+ * fishertest_rxc_p_value (string table, int64 replicates, int64 seed)
+ *
+ * @par Examples:
+ * <br>
+ * apply(build(<t:string>[i=0:0,1,0], '\'3,1,2;1,3,5;0,2,6\''),
+ *       p, fishertest_rxc_p_value(t))
+ **/
+
+/* The most work of the exact test, in edges and path lengths followed, before
+ * the one-argument form gives up on it and returns NaN
+ */
+#define RXC_EXACT_WORK (1 << 22)
+
+/* The largest table total the exact test tries */
+#define RXC_EXACT_TOTAL (1 << 20)
+
+/* The most replicates of the Monte Carlo test */
+#define RXC_MAX_REPLICATES 10000000
+
+/* The most threads of one Monte Carlo test. SciDB evaluates functions on
+ * many cells at once already, so this stays small.
+ */
+#define RXC_THREADS 4u
+
+/* The replicates each thread takes at a time */
+#define RXC_BLOCK 256
+
+/* Past path lengths closer than this are merged into one */
+#define RXC_MERGE_EPS 1e-10
+
+/* log(x!) for a whole number x, from the log-factorial table of dhyper
+ * where it reaches, without lgamma and the global sign it sets. The table
+ * t must be built through the table total, which bounds every x.
+ */
+static inline double
+rxc_lfact(double x, const double *t)
+{
+  if(t && x <= LFACT_MAX) return t[2*(int)x] + t[2*(int)x + 1];
+  if(x == 0) return 0;
+  return (x + 0.5)*log(x) - x + M_LN_SQRT_2PI + stirlerr(x);
+}
+
+/* A table of counts, row-major */
+struct rxc_table
+{
+  int rows, cols;
+  vector<double> x;
+  vector<double> rsum, csum;
+  double total;
+};
+
+/* Parse '3,1;1,3' into a table, dropping empty rows and columns */
+static rxc_table
+rxc_parse(const char *s)
+{
+  vector<vector<double> > rows(1);
+  const char *p = s;
+  for(;;)
+  {
+    while(*p == ' ' || *p == '\t' || *p == '\n') ++p;
+    if(*p == 0) break;
+    if(*p == ';')
+    {
+      rows.push_back(vector<double>());
+      ++p;
+      continue;
+    }
+    if(*p == ',')
+    {
+      ++p;
+      continue;
+    }
+    char *end;
+    double v = strtod(p, &end);
+    if(end == p || !(v >= 0) || v != floor(v) || v > 1e15)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_FISHER_RXC)
+        << "counts must be non-negative integers";
+    }
+    rows.back().push_back(v);
+    p = end;
+  }
+  if(!rows.empty() && rows.back().empty()) rows.pop_back();
+  if(rows.empty() || rows[0].empty())
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_FISHER_RXC)
+      << "the table is empty";
+  }
+  size_t c = rows[0].size();
+  for(size_t i = 1; i < rows.size(); ++i)
+  {
+    if(rows[i].size() != c)
+    {
+      throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_FISHER_RXC)
+        << "the rows have different lengths";
+    }
+  }
+  vector<double> rsum(rows.size(), 0), csum(c, 0);
+  for(size_t i = 0; i < rows.size(); ++i)
+  {
+    for(size_t j = 0; j < c; ++j)
+    {
+      rsum[i] += rows[i][j];
+      csum[j] += rows[i][j];
+    }
+  }
+  rxc_table t;
+  t.total = 0;
+  vector<size_t> keep;
+  for(size_t j = 0; j < c; ++j) if(csum[j] > 0) keep.push_back(j);
+  for(size_t i = 0; i < rows.size(); ++i)
+  {
+    if(rsum[i] == 0) continue;
+    t.rsum.push_back(rsum[i]);
+    t.total += rsum[i];
+    for(size_t j = 0; j < keep.size(); ++j) t.x.push_back(rows[i][keep[j]]);
+  }
+  for(size_t j = 0; j < keep.size(); ++j) t.csum.push_back(csum[keep[j]]);
+  t.rows = t.rsum.size();
+  t.cols = t.csum.size();
+  return t;
+}
+
+/* The exact test, by the network algorithm of Mehta and Patel. The tables
+ * with the given margins are paths through a network whose nodes, one
+ * stage per column, are the row sums left after filling the columns so
+ * far, sorted, since the rest of the table depends on nothing else. A
+ * path's length is its sum of -log(x!) over the cells filled, and a
+ * table's probability is exp(K + length) for a constant K.
+ *
+ * The longest and shortest completions from every node are found first,
+ * by a memoized pass over the network. The paths from the start then go
+ * forward a stage at a time, each node keeping the distinct lengths of the
+ * paths reaching it with their multiplicities. Along each edge, a path
+ * whose every completion is at most as likely as the observed table counts
+ * at the total probability of its completions, which has a closed form; a
+ * path none of whose completions is drops out; only the rest go on.
+ */
+class rxc_exact
+{
+  struct Hash
+  {
+    size_t operator()(vector<int> const& v) const
+    {
+      size_t h = 0;
+      for(size_t i = 0; i < v.size(); ++i) h = h*1000003 + v[i];
+      return h;
+    }
+  };
+
+  struct Past
+  {
+    double length;
+    double count;
+    bool operator<(Past const& o) const { return length < o.length; }
+  };
+  typedef unordered_map<vector<int>, vector<Past>, Hash> Stage;
+
+/* The longest and shortest completion from a node */
+  struct Span
+  {
+    double hi, lo;
+  };
+  typedef unordered_map<vector<int>, Span, Hash> Spans;
+
+  vector<double> lf;     // log(n!)
+  vector<int> cols;      // the column sums, in stage order
+  vector<int> after;     // after[j] = sum of cols[j..]
+  vector<Spans> spans;   // by stage
+  double K, limit;
+  size_t work;
+
+/* Call f(length, child) for every way to fill a column of sum c under the
+ * row sums r, where child is the sorted row sums left
+ */
+  template<class F>
+  void allocate(vector<int> const& r, int c, F const& f)
+  {
+    vector<int> tail(r.size() + 1, 0), child(r.size()), key(r.size());
+    for(int i = r.size() - 1; i >= 0; --i) tail[i] = tail[i + 1] + r[i];
+    allocate(r, tail, 0, c, 0, child, key, f);
+  }
+
+  template<class F>
+  void allocate(vector<int> const& r, vector<int> const& tail, size_t i, int left,
+                double length, vector<int>& child, vector<int>& key, F const& f)
+  {
+// The last row takes the rest
+    if(i + 1 == r.size())
+    {
+      child[i] = r[i] - left;
+      key = child;
+      sort(key.begin(), key.end());
+      f(length - lf[left], key);
+      return;
+    }
+    for(int x = max(0, left - tail[i + 1]); x <= min(r[i], left) && work <= RXC_EXACT_WORK; ++x)
+    {
+      child[i] = r[i] - x;
+      allocate(r, tail, i + 1, left - x, length - lf[x], child, key, f);
+    }
+  }
+
+  Span span(size_t j, vector<int> const& r)
+  {
+    Span s;
+    if(j + 1 == cols.size())
+    {
+      s.hi = 0;
+      for(size_t i = 0; i < r.size(); ++i) s.hi -= lf[r[i]];
+      s.lo = s.hi;
+      return s;
+    }
+    Spans::iterator it = spans[j].find(r);
+    if(it != spans[j].end()) return it->second;
+    s.hi = -INFINITY;
+    s.lo = INFINITY;
+    allocate(r, cols[j], [&](double length, vector<int> const& child)
+    {
+      ++work;
+      Span c = span(j + 1, child);
+      s.hi = max(s.hi, length + c.hi);
+      s.lo = min(s.lo, length + c.lo);
+    });
+    spans[j][r] = s;
+    return s;
+  }
+
+/* log of the sum over the completions of exp(length) */
+  double completions(vector<int> const& r, size_t j) const
+  {
+    double v = lf[after[j]];
+    for(size_t i = 0; i < r.size(); ++i) v -= lf[r[i]];
+    for(size_t k = j; k < cols.size(); ++k) v -= lf[cols[k]];
+    return v;
+  }
+
+public:
+/* The p-value of the table t, or NaN when it takes too much work */
+  double p_value(rxc_table const& t)
+  {
+    if(t.rows < 2 || t.cols < 2) return 1;
+    if(t.total > RXC_EXACT_TOTAL) return NAN;
+    int N = t.total;
+    const double *table = lfact_table(N);
+    lf.resize(N + 1);
+    for(int n = 0; n <= N; ++n) lf[n] = rxc_lfact(n, table);
+// Rows are the shorter side, so that the nodes are small
+    bool flip = t.rows > t.cols;
+    int R = flip ? t.cols : t.rows;
+    vector<int> r(R);
+    for(int i = 0; i < R; ++i) r[i] = flip ? t.csum[i] : t.rsum[i];
+    cols.clear();
+    for(int j = 0; j < (flip ? t.rows : t.cols); ++j) cols.push_back(flip ? t.rsum[j] : t.csum[j]);
+    sort(cols.rbegin(), cols.rend());
+    after.assign(cols.size() + 1, 0);
+    for(int j = cols.size() - 1; j >= 0; --j) after[j] = after[j + 1] + cols[j];
+
+    double observed = 0;
+    for(size_t k = 0; k < t.x.size(); ++k) observed -= lf[(int)t.x[k]];
+    K = -lf[N];
+    for(int i = 0; i < t.rows; ++i) K += lf[(int)t.rsum[i]];
+    for(int j = 0; j < t.cols; ++j) K += lf[(int)t.csum[j]];
+// R's relative tolerance of 1e-7 on the observed probability
+    limit = observed + log(1 + 1e-7);
+    work = 0;
+    spans.assign(cols.size(), Spans());
+
+    double p = 0;
+    Stage stage;
+    sort(r.begin(), r.end());
+    Past start = {0, 1};
+    stage[r].push_back(start);
+    for(size_t j = 0; j + 1 < cols.size() && !stage.empty(); ++j)
+    {
+      Stage next;
+      for(Stage::iterator it = stage.begin(); it != stage.end(); ++it)
+      {
+        vector<Past>& past = it->second;
+// Merge the paths of (nearly) equal length
+        sort(past.begin(), past.end());
+        size_t n = 0;
+        for(size_t k = 0; k < past.size(); ++k)
+        {
+          if(n > 0 && past[k].length - past[n - 1].length < RXC_MERGE_EPS) past[n - 1].count += past[k].count;
+          else past[n++] = past[k];
+        }
+        past.resize(n);
+// sum[k] = the sum over the k shortest paths of count*exp(length - top)
+        double top = past[n - 1].length;
+        vector<double> sum(n + 1, 0);
+        for(size_t k = 0; k < n; ++k) sum[k + 1] = sum[k] + past[k].count*exp(past[k].length - top);
+        allocate(it->first, cols[j], [&](double length, vector<int> const& child)
+        {
+          ++work;
+          Span b = span(j + 1, child);
+          Past hi = {limit - length - b.hi, 0}, lo = {limit - length - b.lo, 0};
+// The shortest paths count whatever the completion, the longest never do
+          size_t counted = upper_bound(past.begin(), past.end(), hi) - past.begin();
+          size_t open = upper_bound(past.begin(), past.end(), lo) - past.begin();
+          if(counted > 0) p += sum[counted]*exp(K + top + length + completions(child, j + 1));
+          if(open == counted) return;
+          vector<Past>& dst = next[child];
+          for(size_t k = counted; k < open; ++k)
+          {
+            Past q = {past[k].length + length, past[k].count};
+            dst.push_back(q);
+          }
+          work += open - counted;
+        });
+        if(work > RXC_EXACT_WORK) return NAN;
+      }
+      stage.swap(next);
+    }
+    return min(1.0, p);
+  }
+};
+
+/* A counter-based random number generator: the uniform deviate number k of
+ * replicate b is a hash of (seed, b, k), so each replicate draws the same
+ * numbers whichever thread simulates it.
+ */
+static inline uint64_t
+rxc_mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+struct rxc_stream
+{
+  uint64_t key;
+  uint64_t k;
+
+  rxc_stream(uint64_t seed, uint64_t b): key(rxc_mix(rxc_mix(seed) + b*0x9e3779b97f4a7c15ULL)), k(0) {}
+
+/* A uniform deviate in (0, 1) */
+  double uniform()
+  {
+    uint64_t z = rxc_mix(key + (++k)*0x9e3779b97f4a7c15ULL);
+    return ((z >> 11) + 0.5)*(1.0/9007199254740992.0);
+  }
+};
+
+/* A hypergeometric deviate: the white balls among k drawn from m white and
+ * n black ones, by inversion from the mode outward, alternating sides, so
+ * that the expected work grows with the standard deviation only.
+ */
+static double
+rxc_rhyper(double m, double n, double k, rxc_stream& rng)
+{
+  double lo = max(0.0, k - n), hi = min(k, m);
+  if(lo == hi) return lo;
+  double mode = floor((k + 1)*(m + 1)/(m + n + 2));
+  mode = max(lo, min(hi, mode));
+  double u = rng.uniform();
+  double d = dhyper(mode, m, n, k, 0);
+  u -= d;
+  if(u <= 0) return mode;
+  double l = mode, r = mode, dl = d, dr = d;
+  while(l > lo || r < hi)
+  {
+    if(r < hi)
+    {
+      dr *= ((m - r)*(k - r))/((r + 1)*(n - k + r + 1));
+      ++r;
+      u -= dr;
+      if(u <= 0) return r;
+    }
+    if(l > lo)
+    {
+      dl *= (l*(n - k + l))/((m - l + 1)*(k - l + 1));
+      --l;
+      u -= dl;
+      if(u <= 0) return l;
+    }
+  }
+  return mode;
+}
+
+/* The sum of log(x!) over a random table with the margins of t, filled row
+ * by row, each row a multivariate hypergeometric draw from the column sums
+ * left.
+ */
+static double
+rxc_random_stat(rxc_table const& t, rxc_stream& rng, vector<double>& c, const double *lf)
+{
+  c = t.csum;
+  double left = t.total;
+  double s = 0;
+  for(int i = 0; i < t.rows; ++i)
+  {
+    double need = t.rsum[i];
+    double pool = left;
+    for(int j = 0; j < t.cols; ++j)
+    {
+      double x;
+      if(i + 1 == t.rows) x = c[j];
+      else if(j + 1 == t.cols) x = need;
+      else x = rxc_rhyper(c[j], pool - c[j], need, rng);
+      pool -= c[j];
+      c[j] -= x;
+      need -= x;
+      s += rxc_lfact(x, lf);
+    }
+    left -= t.rsum[i];
+  }
+  return s;
+}
+
+/* The Monte Carlo p-value of R's fisher.test(simulate.p.value = TRUE):
+ * (1 + the replicates at most as likely as t) / (B + 1). The replicates
+ * are shared out among threads in blocks, and only their count is added
+ * up, so the result depends on the seed but not on the threads. At most
+ * RXC_THREADS threads run, fewer for small B.
+ */
+static double
+rxc_simulate(rxc_table const& t, int64_t B, uint64_t seed)
+{
+  if(t.rows < 2 || t.cols < 2) return 1;
+  if(B < 1) return NAN;
+  if(B > RXC_MAX_REPLICATES)
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_FISHER_RXC)
+      << "at most 10000000 replicates";
+  }
+  const double *lf = lfact_table((int) min<double>(t.total, LFACT_MAX));
+  double observed = 0;
+  for(size_t k = 0; k < t.x.size(); ++k) observed += rxc_lfact(t.x[k], lf);
+// R's tolerance: STATISTIC/almost.1 on the negated statistic
+  double limit = observed/(1 + 64*DBL_EPSILON);
+  atomic<int64_t> next(0);
+  atomic<int64_t> hits(0);
+  auto worker = [&]()
+  {
+    vector<double> c;
+    int64_t mine = 0;
+    for(int64_t b0 = next.fetch_add(RXC_BLOCK); b0 < B; b0 = next.fetch_add(RXC_BLOCK))
+    {
+      for(int64_t b = b0; b < min(B, b0 + RXC_BLOCK); ++b)
+      {
+        rxc_stream rng(seed, b);
+        if(rxc_random_stat(t, rng, c, lf) >= limit) ++mine;
+      }
+    }
+    hits += mine;
+  };
+  size_t nThreads = min<int64_t>(min(RXC_THREADS, max(1u, thread::hardware_concurrency())),
+                                 (B + RXC_BLOCK - 1)/RXC_BLOCK);
+  vector<thread> threads;
+  for(size_t i = 1; i < nThreads; ++i) threads.push_back(thread(worker));
+  worker();
+  for(size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  return (1.0 + hits)/(B + 1.0);
+}
+
+/*
+ * @brief Fisher's exact test of an r x c contingency table
+ * @param table (string) The counts, rows separated by ';' and counts by ','
+ * @returns The exact p-value from the network algorithm, or NaN when that
+ * takes too much work; the three-argument form tests such tables by Monte
+ * Carlo.
+ */
+static void
+superfun_fisher_rxc(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  rxc_table t = rxc_parse(args[0]->getString());
+  rxc_exact e;
+  res->setDouble(e.p_value(t));
+}
+
+/*
+ * @brief Monte Carlo Fisher test of an r x c contingency table
+ * @param table (string) The counts, rows separated by ';' and counts by ','
+ * @param replicates (int64) The number of random tables, at most 10000000
+ * @param seed (int64) The random number seed
+ * @returns The p-value of fisher.test(simulate.p.value = TRUE, B = replicates)
+ */
+static void
+superfun_fisher_rxc_simulate(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  rxc_table t = rxc_parse(args[0]->getString());
+  res->setDouble(rxc_simulate(t, args[1]->getInt64(), (uint64_t) args[2]->getInt64()));
+}
+
+REGISTER_FUNCTION(fishertest_rxc_p_value, list_of("string"), "double", superfun_fisher_rxc);
+REGISTER_FUNCTION(fishertest_rxc_p_value, list_of("string")("int64")("int64"), "double", superfun_fisher_rxc_simulate);
@@ -0,0 +1,1549 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+/*  The *hyper stats functions in this file are adapted from the R source code:
+ *
+ *  R : A Computer Language for Statistical Data Analysis
+ *  Copyright (C) 1995, 1996  Robert Gentleman and Ross Ihaka
+ *  Copyright (C) 1997--2005  The R Core Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, a copy is available at
+ *  http://www.r-project.org/Licenses/
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HYPER_SIMD
+/* GCC 4.9, which the Makefile prefers when it is installed, cannot test
+ * for AVX-512 at run time */
+#if __GNUC__ >= 5 || defined(__clang__)
+#define HYPER_AVX512
+#endif
+#endif
+
+#include <boost/assign.hpp>
+#include <boost/math/tools/roots.hpp>
+
+#include "query/FunctionLibrary.h"
+#include "query/FunctionDescription.h"
+#include "system/ErrorsLibrary.h"
+
+#include "superfunpack.h"
+#include "R/fun.h"
+
+using namespace std;
+using namespace scidb;
+using namespace boost::assign;
+
+/** @file hyper.cpp
+ *
+ * @brief Hypergeometric distribution functions, Fisher's exact test for
+ * 2x2 tables, and its asymptotic alternatives.
+ *
+ * @par Synopsis: dhyper (double x, double m, double n, double k),
+ * phyper (double x, double m, double n, double k, bool lower_tail),
+ * qhyper (double p, double m, double n, double k, bool lower_tail),
+ * fishertest_odds_ratio (double x, double m, double n, double k),
+ * fishertest_p_value (double x, double m, double n, double k, string alternative),
+ * dhyper_log (double x, double m, double n, double k),
+ * phyper_log (double x, double m, double n, double k, bool lower_tail),
+ * fishertest_log_p_value (double x, double m, double n, double k, string alternative),
+ * fisher_test (double x, double m, double n, double k [, string alternative,
+ * double conf_level]), fisher_p_value (fisher), fisher_odds_ratio (fisher),
+ * fisher_conf_lower (fisher), fisher_conf_upper (fisher),
+ * contingency_test (double x, double m, double n, double k [, string method]),
+ * contingency_p_value (contingency), contingency_statistic (contingency),
+ * contingency_method (contingency)
+ **/
+
+/* ***************************************************************************
+ *       Hypergeometric stuff in support of Fisher's exact test 
+ *
+ * Adapted from the R source code, Copyrigth 1998-2014 R Foundataion.
+ * The distribution functions are R's own, in the R directory; the changes
+ * are mainly to use the available boost root-finding method.
+ * ***************************************************************************
+ */
+/* Kernels for the sums over the densities, which take most of the time of
+ * the odds ratio estimate and of tabulating a distribution:
+ *
+ *   axpy_max  d = a + s*b, returning the largest element of d (NaNs ignored)
+ *   exp_sum   d = exp(d - shift), returning the sum of d
+ *   dot       the sum of a*b
+ *
+ * Each comes in a scalar version and, on x86-64, AVX2 and AVX-512 versions
+ * built with function target attributes, so that the plugin still loads on
+ * older processors; the AVX-512 ones need GCC 5 or later. The best version the processor supports is picked once
+ * at load time. The vector exponential evaluates a degree 13 Taylor
+ * polynomial after reducing the argument by multiples of log(2); it agrees
+ * with the libm exp to about one part in 1e15 down to the subnormal range.
+ */
+struct hyper_kernels
+{
+  double (*axpy_max)(double *d, const double *a, double s, const double *b, int n);
+  double (*exp_sum)(double *d, double shift, int n);
+  double (*dot)(const double *a, const double *b, int n);
+};
+
+static double
+axpy_max_scalar(double *d, const double *a, double s, const double *b, int n)
+{
+  double maxd = -INFINITY;
+  for(int j=0;j<n;++j)
+  {
+    d[j] = a[j] + s*b[j];
+    if(d[j] > maxd) maxd = d[j];
+  }
+  return maxd;
+}
+
+static double
+exp_sum_scalar(double *d, double shift, int n)
+{
+  double sum = 0;
+  for(int j=0;j<n;++j)
+  {
+    d[j] = exp(d[j] - shift);
+    sum = sum + d[j];
+  }
+  return sum;
+}
+
+static double
+dot_scalar(const double *a, const double *b, int n)
+{
+  double sum = 0;
+  for(int j=0;j<n;++j) sum = sum + a[j]*b[j];
+  return sum;
+}
+
+#ifdef HYPER_SIMD
+/* The coefficients 1/k! of the exponential polynomial, highest first */
+static const double exp_coef[14] = {
+  1.0/6227020800.0, 1.0/479001600.0, 1.0/39916800.0, 1.0/3628800.0,
+  1.0/362880.0, 1.0/40320.0, 1.0/5040.0, 1.0/720.0, 1.0/120.0, 1.0/24.0,
+  1.0/6.0, 0.5, 1.0, 1.0
+};
+#define EXP_LOG2E  1.44269504088896338700e+00
+#define EXP_LN2_HI 6.93147180369123816490e-01
+#define EXP_LN2_LO 1.90821492927058770002e-10
+/* Below this exp rounds to zero. The kernels zero such arguments up front,
+ * since the underflow of scaling them is very slow on some processors. */
+#define EXP_MIN    -746.0
+
+__attribute__((target("avx2,fma"))) static inline __m256d
+exp_avx2(__m256d x)
+{
+  __m256d zero = _mm256_cmp_pd(x, _mm256_set1_pd(EXP_MIN), _CMP_LT_OQ);
+  __m256d nan  = _mm256_cmp_pd(x, x, _CMP_UNORD_Q);
+  x = _mm256_andnot_pd(zero, x);
+  __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(EXP_LOG2E)),
+                              _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(EXP_LN2_HI), x);
+  r = _mm256_fnmadd_pd(n, _mm256_set1_pd(EXP_LN2_LO), r);
+  __m256d p = _mm256_set1_pd(exp_coef[0]);
+  for(int i=1;i<14;++i) p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(exp_coef[i]));
+// Scale by 2^n in two halves so that subnormal results round only once
+  __m128i e  = _mm256_cvtpd_epi32(n);
+  __m128i e1 = _mm_srai_epi32(e, 1);
+  __m128i e2 = _mm_sub_epi32(e, e1);
+  __m256i bias = _mm256_set1_epi64x(1023);
+  p = _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(
+        _mm256_add_epi64(_mm256_cvtepi32_epi64(e1), bias), 52)));
+  p = _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(
+        _mm256_add_epi64(_mm256_cvtepi32_epi64(e2), bias), 52)));
+// NaN in, NaN out, as from the libm exp
+  return _mm256_or_pd(_mm256_andnot_pd(zero, p), nan);
+}
+
+__attribute__((target("avx2,fma"))) static double
+axpy_max_avx2(double *d, const double *a, double s, const double *b, int n)
+{
+  int j = 0;
+  __m256d vs = _mm256_set1_pd(s);
+  __m256d vmax = _mm256_set1_pd(-INFINITY);
+  for(;j+4<=n;j+=4)
+  {
+    __m256d v = _mm256_fmadd_pd(vs, _mm256_loadu_pd(b+j), _mm256_loadu_pd(a+j));
+    _mm256_storeu_pd(d+j, v);
+// max_pd returns its second operand when either is NaN
+    vmax = _mm256_max_pd(v, vmax);
+  }
+  double m[4];
+  _mm256_storeu_pd(m, vmax);
+  double maxd = max(max(m[0], m[1]), max(m[2], m[3]));
+  for(;j<n;++j)
+  {
+    d[j] = a[j] + s*b[j];
+    if(d[j] > maxd) maxd = d[j];
+  }
+  return maxd;
+}
+
+__attribute__((target("avx2,fma"))) static double
+exp_sum_avx2(double *d, double shift, int n)
+{
+  int j = 0;
+  __m256d vshift = _mm256_set1_pd(shift);
+  __m256d vsum = _mm256_setzero_pd();
+  for(;j+4<=n;j+=4)
+  {
+    __m256d v = exp_avx2(_mm256_sub_pd(_mm256_loadu_pd(d+j), vshift));
+    _mm256_storeu_pd(d+j, v);
+    vsum = _mm256_add_pd(vsum, v);
+  }
+  double t[4];
+  _mm256_storeu_pd(t, vsum);
+  double sum = (t[0] + t[1]) + (t[2] + t[3]);
+  for(;j<n;++j)
+  {
+    d[j] = exp(d[j] - shift);
+    sum = sum + d[j];
+  }
+  return sum;
+}
+
+__attribute__((target("avx2,fma"))) static double
+dot_avx2(const double *a, const double *b, int n)
+{
+  int j = 0;
+  __m256d vsum = _mm256_setzero_pd();
+  for(;j+4<=n;j+=4)
+    vsum = _mm256_fmadd_pd(_mm256_loadu_pd(a+j), _mm256_loadu_pd(b+j), vsum);
+  double t[4];
+  _mm256_storeu_pd(t, vsum);
+  double sum = (t[0] + t[1]) + (t[2] + t[3]);
+  for(;j<n;++j) sum = sum + a[j]*b[j];
+  return sum;
+}
+
+#ifdef HYPER_AVX512
+__attribute__((target("avx512f"))) static inline __m512d
+exp_avx512(__m512d x)
+{
+  __mmask8 zero = _mm512_cmp_pd_mask(x, _mm512_set1_pd(EXP_MIN), _CMP_LT_OQ);
+  x = _mm512_mask_mov_pd(x, zero, _mm512_setzero_pd());
+  __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(EXP_LOG2E)),
+                                   _MM_FROUND_TO_NEAREST_INT);
+  __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(EXP_LN2_HI), x);
+  r = _mm512_fnmadd_pd(n, _mm512_set1_pd(EXP_LN2_LO), r);
+  __m512d p = _mm512_set1_pd(exp_coef[0]);
+  for(int i=1;i<14;++i) p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(exp_coef[i]));
+  p = _mm512_scalef_pd(p, n);
+  p = _mm512_mask_mov_pd(p, zero, _mm512_setzero_pd());
+  __mmask8 nan = _mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q);
+  return _mm512_mask_mov_pd(p, nan, _mm512_set1_pd(NAN));
+}
+
+/* The sum of the elements, by halves, since _mm512_reduce_add_pd is
+ * missing before GCC 7 */
+__attribute__((target("avx512f"))) static inline double
+reduce_add_avx512(__m512d v)
+{
+  __m256d h = _mm256_add_pd(_mm512_extractf64x4_pd(v, 0), _mm512_extractf64x4_pd(v, 1));
+  double t[4];
+  _mm256_storeu_pd(t, h);
+  return (t[0] + t[1]) + (t[2] + t[3]);
+}
+
+__attribute__((target("avx512f"))) static double
+axpy_max_avx512(double *d, const double *a, double s, const double *b, int n)
+{
+  int j = 0;
+  __m512d vs = _mm512_set1_pd(s);
+  __m512d vmax = _mm512_set1_pd(-INFINITY);
+  for(;j+8<=n;j+=8)
+  {
+    __m512d v = _mm512_fmadd_pd(vs, _mm512_loadu_pd(b+j), _mm512_loadu_pd(a+j));
+    _mm512_storeu_pd(d+j, v);
+    vmax = _mm512_max_pd(v, vmax);
+  }
+  double m[8];
+  _mm512_storeu_pd(m, vmax);
+  double maxd = -INFINITY;
+  for(int i=0;i<8;++i) if(m[i] > maxd) maxd = m[i];
+  for(;j<n;++j)
+  {
+    d[j] = a[j] + s*b[j];
+    if(d[j] > maxd) maxd = d[j];
+  }
+  return maxd;
+}
+
+__attribute__((target("avx512f"))) static double
+exp_sum_avx512(double *d, double shift, int n)
+{
+  int j = 0;
+  __m512d vshift = _mm512_set1_pd(shift);
+  __m512d vsum = _mm512_setzero_pd();
+  for(;j+8<=n;j+=8)
+  {
+    __m512d v = exp_avx512(_mm512_sub_pd(_mm512_loadu_pd(d+j), vshift));
+    _mm512_storeu_pd(d+j, v);
+    vsum = _mm512_add_pd(vsum, v);
+  }
+  double sum = reduce_add_avx512(vsum);
+  for(;j<n;++j)
+  {
+    d[j] = exp(d[j] - shift);
+    sum = sum + d[j];
+  }
+  return sum;
+}
+
+__attribute__((target("avx512f"))) static double
+dot_avx512(const double *a, const double *b, int n)
+{
+  int j = 0;
+  __m512d vsum = _mm512_setzero_pd();
+  for(;j+8<=n;j+=8)
+    vsum = _mm512_fmadd_pd(_mm512_loadu_pd(a+j), _mm512_loadu_pd(b+j), vsum);
+  double sum = reduce_add_avx512(vsum);
+  for(;j<n;++j) sum = sum + a[j]*b[j];
+  return sum;
+}
+#endif
+#endif
+
+static hyper_kernels
+select_kernels()
+{
+  hyper_kernels k = {axpy_max_scalar, exp_sum_scalar, dot_scalar};
+#ifdef HYPER_SIMD
+  __builtin_cpu_init();
+#ifdef HYPER_AVX512
+  if(__builtin_cpu_supports("avx512f"))
+  {
+    k.axpy_max = axpy_max_avx512;
+    k.exp_sum  = exp_sum_avx512;
+    k.dot      = dot_avx512;
+    return k;
+  }
+#endif
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    k.axpy_max = axpy_max_avx2;
+    k.exp_sum  = exp_sum_avx2;
+    k.dot      = dot_avx2;
+  }
+#endif
+  return k;
+}
+
+static const hyper_kernels kernels = select_kernels();
+
+/* Tables with more support points than this are summed outward from the
+ * mode instead of over the whole support; see hyper_wide.
+ */
+#define HYPER_EXACT_POINTS 16384
+/* The largest relative share of a sum that hyper_wide leaves out per tail */
+#define HYPER_TRUNCATE_EPS (DBL_EPSILON/16)
+/* hyper_wide recomputes a term exactly at least this often */
+#define HYPER_ANCHOR_STEPS 64
+
+/* The support lo..hi of x given the margins m, n and k, and the log
+ * densities of the central hypergeometric distribution over it. These
+ * depend only on the margins, so they are computed once per table and then
+ * shared by all the evaluations of the noncentral distribution at different
+ * odds ratios during root finding. The d vector is scratch space for those
+ * evaluations. Wide supports of more than HYPER_EXACT_POINTS points are not
+ * tabulated.
+ */
+struct hyper_support
+{
+  double m, n, k;
+  double lo, hi;
+  int ns;
+  bool wide;
+  vector<double> support;
+  vector<double> logdc;
+  vector<double> d;
+
+  void reset(double M, double N, double K)
+  {
+    m  = M;
+    n  = N;
+    k  = K;
+    lo = round(max(0.0, k-n));
+    hi = round(min(k, m));
+    ns = hi - lo + 1;
+    wide = ns > HYPER_EXACT_POINTS;
+    if(ns<=0 || wide) return;
+    support.resize(ns);
+    logdc.resize(ns);
+    d.resize(ns);
+    for(int j=0;j<ns;++j)
+    {
+      support[j] = lo + j;
+// Not accurate:
+//      logdc[j]   = log(boost::math::pdf(h,support[j]));
+      logdc[j]   = dhyper (support[j], m, n, k, 1);
+    }
+  }
+};
+
+/* The noncentral hypergeometric distribution of a wide support, summed over
+ * the points that matter only. The density is log-concave, so the terms
+ * fall off geometrically on both sides of the mode at ratios that only get
+ * smaller further out. The sums start at the mode (or at x, for the tails
+ * of x) and walk outward, one term from the last by the density ratio, and
+ * stop once the geometric bound t r / (1 - r) on everything beyond the term
+ * t, with r its ratio to the next one, is below HYPER_TRUNCATE_EPS of the
+ * sum so far. The cost is then about 20 standard deviations of terms
+ * instead of the whole support.
+ *
+ * Error bound: the truncation leaves out at most HYPER_TRUNCATE_EPS of
+ * each one-sided sum, and the recurrence, recomputed from dhyper every
+ * HYPER_ANCHOR_STEPS terms, adds at most about 4 HYPER_ANCHOR_STEPS
+ * rounding errors (3e-14) to a term. Both are small next to the error of
+ * the dhyper log densities, which also limits tabulated supports: the
+ * probabilities, tail probabilities included, come out within about 1e-13
+ * relative error of the exact ones either way while m + n is within the
+ * log-factorial table (LFACT_MAX), and within about 1e-12 beyond it.
+ */
+class hyper_wide
+{
+  double m, n, k, lo, hi;
+  double ncp, logncp;
+  double logmode;   // the unnormalized log density at the mode
+  double total;     // the sum of the terms relative to the mode
+  double jtotal;    // the same weighted by x
+
+public:
+  double mode;
+
+  hyper_wide(): total(0) {}
+
+  void init(hyper_support const& s, double NCP)
+  {
+    locate(s.m, s.n, s.k, NCP);
+    total = jtotal = 0;
+    walk(mode, 1, 0, &total, &jtotal);
+    walk(mode - 1, -1, 0, &total, &jtotal);
+  }
+
+/* Set the margins and find the mode, without summing anything */
+  void locate(double M, double N, double K, double NCP)
+  {
+    m = M;
+    n = N;
+    k = K;
+    lo = round(max(0.0, k-n));
+    hi = round(min(k, m));
+    ncp = NCP;
+    logncp = log(ncp);
+// The mode is where the ratio of successive terms drops below one
+    double a = lo, b = hi;
+    while(a < b)
+    {
+      double j = floor((a + b)/2);
+      if(ratio(j) < 1) b = j;
+      else a = j + 1;
+    }
+    mode = a;
+    logmode = logd(mode);
+  }
+
+  double logd(double j) const
+  {
+    return dhyper(j, m, n, k, 1) + logncp*j;
+  }
+
+/* The ratio of the term at j + 1 to the term at j */
+  double ratio(double j) const
+  {
+    return ncp*((m - j)*(k - j))/((j + 1)*(n - k + j + 1));
+  }
+
+/* Add the terms from j outward in direction dir (1 or -1), relative to the
+ * mode, to *sum, and the terms times x to *jsum. The stopping rule is
+ * against base + *sum.
+ */
+  void walk(double j, int dir, double base, double *sum, double *jsum) const
+  {
+    if(j < lo || j > hi) return;
+    double t = exp(logd(j) - logmode);
+    for(int step = 1;; ++step)
+    {
+      *sum = *sum + t;
+      if(jsum) *jsum = *jsum + j*t;
+      double r = dir > 0 ? ratio(j) : 1/ratio(j - 1);
+      j = j + dir;
+      if(j < lo || j > hi) return;
+      if(r < 1 && t*r/(1 - r) <= HYPER_TRUNCATE_EPS*(base + *sum)) return;
+      if(step % HYPER_ANCHOR_STEPS == 0) t = exp(logd(j) - logmode);
+      else t = t*r;
+    }
+  }
+
+  double mean() const
+  {
+    return jtotal/total;
+  }
+
+/* P(X <= x) */
+  double p_less(double x) const
+  {
+    x = floor(x);
+    if(x < lo) return 0;
+    if(x >= hi) return 1;
+    if(x >= mode) return 1 - p_greater(x + 1);
+    double sum = 0;
+    walk(x, -1, 0, &sum, NULL);
+    return sum/total;
+  }
+
+/* P(X >= x) */
+  double p_greater(double x) const
+  {
+    x = ceil(x);
+    if(x <= lo) return 1;
+    if(x > hi) return 0;
+    if(x <= mode) return 1 - p_less(x - 1);
+    double sum = 0;
+    walk(x, 1, 0, &sum, NULL);
+    return sum/total;
+  }
+
+/* The total probability of the outcomes less likely than x up to the
+ * relative error relerr, or at most as likely with inclusive set.
+ */
+  double p_two_sided(double x, double relerr, bool inclusive) const
+  {
+    if(x < lo || x > hi) return NAN;
+    double left, right;
+    if(!cutoffs(floor(x), relerr, inclusive, &left, &right)) return 1;
+    double sum = 0;
+    walk(left, -1, 0, &sum, NULL);
+    walk(right, 1, 0, &sum, NULL);
+    return sum/total;
+  }
+
+/* The log of p_two_sided of the central distribution, which needs no sums
+ * of its own: the two tails beyond the cutoffs are phyper tails, added in
+ * log space so that p-values below the smallest double still come out.
+ */
+  double log_p_two_sided(double x, double relerr, bool inclusive) const
+  {
+    if(x < lo || x > hi) return NAN;
+    double left, right;
+    if(!cutoffs(floor(x), relerr, inclusive, &left, &right)) return 0;
+    double a = phyper(left, m, n, k, 1, 1);
+    double b = phyper(right - 1, m, n, k, 0, 1);
+    if(a < b) swap(a, b);
+    if(b == -INFINITY) return a;
+    return a + log1p(exp(b - a));
+  }
+
+/* The points nearest the mode on either side whose densities are below
+ * that of x by the relative error relerr (or equal, with inclusive set),
+ * lo - 1 and hi + 1 where there are none. False when the mode itself is
+ * below, so that every point is.
+ */
+  bool cutoffs(double x, double relerr, bool inclusive, double *left, double *right) const
+  {
+    double limit = logd(x) + log(relerr);
+    auto below = [&](double j)
+    {
+      return inclusive ? logd(j) <= limit : logd(j) < limit;
+    };
+    if(below(mode)) return false;
+    double a = lo - 1, b = mode - 1;
+    while(a < b)
+    {
+      double j = ceil((a + b)/2);
+      if(below(j)) a = j;
+      else b = j - 1;
+    }
+    *left = a;
+    a = mode + 1;
+    b = hi + 1;
+    while(a < b)
+    {
+      double j = floor((a + b)/2);
+      if(below(j)) b = j;
+      else a = j + 1;
+    }
+    *right = a;
+    return true;
+  }
+};
+
+/* The hypergeometric distribution of margins m, n and k, tabulated for
+ * repeated use: the central densities, the lower and upper tail sums, the
+ * densities in increasing order with their running sums for the two-sided
+ * test, the mean, and the odds ratio estimates solved so far by x - lo (NaN
+ * where not solved yet). The densities are normalized exactly like the
+ * noncentral densities of mnhyper at odds ratio one. Wide supports keep
+ * just the central distribution summed from its mode, and no estimates.
+ */
+struct hyper_table : hyper_support
+{
+  vector<double> dens;
+  vector<double> lower;       // P(X <= lo + j)
+  vector<double> upper;       // P(X >= lo + j)
+  vector<double> sorted;      // dens in increasing order
+  vector<double> sorted_sum;  // sorted_sum[j] is the sum of sorted[0..j-1]
+  vector<double> mle;
+  double mean;
+  hyper_wide central;
+
+  void build(double M, double N, double K)
+  {
+    int j;
+    double maxd = -INFINITY, sumd;
+    reset(M, N, K);
+    if(ns<=0) return;
+    if(wide)
+    {
+      central.init(*this, 1);
+      mean = central.mean();
+      return;
+    }
+    dens.resize(ns);
+    lower.resize(ns);
+    upper.resize(ns);
+    sorted_sum.resize(ns + 1);
+    mle.assign(ns, NAN);
+    dens = logdc;
+    for(j=0;j<ns;++j) if(logdc[j] > maxd) maxd = logdc[j];
+    sumd = kernels.exp_sum(&dens[0], maxd, ns);
+    for(j=0;j<ns;++j) dens[j] = dens[j]/sumd;
+    mean = kernels.dot(&support[0], &dens[0], ns);
+    lower[0] = dens[0];
+    for(j=1;j<ns;++j) lower[j] = lower[j-1] + dens[j];
+    upper[ns-1] = dens[ns-1];
+    for(j=ns-2;j>=0;--j) upper[j] = upper[j+1] + dens[j];
+    sorted = dens;
+    sort(sorted.begin(), sorted.end());
+    sorted_sum[0] = 0;
+    for(j=0;j<ns;++j) sorted_sum[j+1] = sorted_sum[j] + sorted[j];
+  }
+
+/* P(X <= x) */
+  double p_less(double x) const
+  {
+    if(x < lo) return 0;
+    if(x >= hi) return 1;
+    if(wide) return central.p_less(x);
+    return lower[(int)(floor(x) - lo)];
+  }
+
+/* P(X >= x) */
+  double p_greater(double x) const
+  {
+    if(x <= lo) return 1;
+    if(x > hi) return 0;
+    if(wide) return central.p_greater(x);
+    return upper[(int)(ceil(x) - lo)];
+  }
+
+/* The two-sided p-value: the total probability of the outcomes less likely
+ * than x, allowing for a small relative error.
+ */
+  double p_two_sided(double x) const
+  {
+    double relerr = 1.000000001;
+    if(x < lo || x > hi) return NAN;
+    if(wide) return central.p_two_sided(x, relerr, false);
+    double threshold = relerr*dens[(int)(x - lo)];
+    return sorted_sum[lower_bound(sorted.begin(), sorted.end(), threshold) - sorted.begin()];
+  }
+
+/* The two-sided p-value as R's fisher.test computes it: the total
+ * probability of the outcomes at most as likely as x, up to a relative
+ * error of 1e-7.
+ */
+  double p_two_sided_r(double x) const
+  {
+    double relerr = 1 + 1e-7;
+    if(x < lo || x > hi) return NAN;
+    if(wide) return central.p_two_sided(x, relerr, true);
+    double threshold = relerr*dens[(int)(x - lo)];
+    return sorted_sum[upper_bound(sorted.begin(), sorted.end(), threshold) - sorted.begin()];
+  }
+
+/* The cache space of the table */
+  size_t points() const
+  {
+    return wide ? 1 : max(ns, 0);
+  }
+};
+
+/* The most hypergeometric tables and table points cached per thread */
+#define HYPER_CACHE_TABLES 64
+#define HYPER_CACHE_POINTS (1 << 16)
+
+/* A per-thread cache of hypergeometric tables by margins, least recently
+ * used first out. Enrichment-style workloads test many x against the same
+ * few margins, and then a test is mostly table lookups.
+ */
+class hyper_cache
+{
+  list<hyper_table> tables;   // most recently used first
+  size_t points;
+
+public:
+  hyper_cache(): points(0) {}
+
+  hyper_table &get(double m, double n, double k)
+  {
+    for(list<hyper_table>::iterator t = tables.begin(); t != tables.end(); ++t)
+    {
+      if(t->m == m && t->n == n && t->k == k)
+      {
+        tables.splice(tables.begin(), tables, t);
+        return tables.front();
+      }
+    }
+    double ns = round(min(k, m)) - round(max(0.0, k-n)) + 1;
+    if(ns > HYPER_EXACT_POINTS) ns = 1;
+    while(!tables.empty() &&
+          (tables.size() >= HYPER_CACHE_TABLES || points + max(ns, 0.0) > HYPER_CACHE_POINTS))
+    {
+      points -= tables.back().points();
+      tables.pop_back();
+    }
+    tables.push_front(hyper_table());
+    tables.front().build(m, n, k);
+    points += tables.front().points();
+    return tables.front();
+  }
+};
+
+static hyper_table &
+hyper_lookup(double m, double n, double k)
+{
+  static thread_local hyper_cache cache;
+  return cache.get(m, n, k);
+}
+
+class mnhyper
+{
+  hyper_support &s;
+  double x;
+  bool invert;
+
+  public:
+    mnhyper(hyper_support&,double);
+    void inv(bool);
+    double operator()(double ncp)
+    {
+      int ns = s.ns;
+      double logncp, maxd, sumd;
+      if(invert && ncp!=0) ncp = 1/ncp;
+      if(ns<=0) return 0;
+      if(s.wide)
+      {
+        hyper_wide w;
+        w.init(s, ncp);
+        return w.mean() - x;
+      }
+      const double *support = &s.support[0];
+      double *d = &s.d[0];
+      logncp = log(ncp);
+      maxd   = kernels.axpy_max(d, &s.logdc[0], logncp, support, ns);
+      sumd   = kernels.exp_sum(d, maxd, ns);
+      return kernels.dot(support, d, ns)/sumd - x;
+    }
+};
+mnhyper::mnhyper(hyper_support &S, double X) : s(S)
+{
+  x = X;
+  invert = false;
+}
+void
+mnhyper::inv(bool b)
+{
+  invert = b;
+}
+
+/* The conditional maximum likelihood estimate of the odds ratio, the odds
+ * ratio at which the mean of the noncentral distribution is x. The mean
+ * increases with the odds ratio, so the estimates already solved for other
+ * x of the same margins bracket the root more tightly than (0, 1].
+ */
+double
+hyper_mle(double x, double m, double n, double k)
+{
+// x indexes the cache of estimates, so like dhyper accept only whole x (not NaN)
+  if(x != floor(x)) return NAN;
+  hyper_table &t = hyper_lookup(m,n,k);
+  mnhyper f(t,x);
+  typedef std::pair<double, double> Result;
+  boost::uintmax_t max_iter=5000;
+  boost::math::tools::eps_tolerance<double> tol(52);
+
+// Check exceptional cases
+// x  u
+// y  v
+  double y = m - x;
+  double u = k - x;
+  double v = n - u;
+  if(x==0 || v==0) return 0;
+  if(u==0 || y==0) return INFINITY;
+  if(x < t.lo || x > t.hi) return NAN;
+
+  int i, j = x - t.lo, nm = t.mle.size();
+  if(j < nm && !isnan(t.mle[j])) return t.mle[j];
+  double mu = t.mean;
+  double a = 0.00000001, b = 1.0;
+
+  double root;
+  Result bracket;
+  if(mu>x)
+  {
+    for(i=min(j,nm)-1;i>=0 && isnan(t.mle[i]);--i);
+    if(i>=0) a = max(a, t.mle[i]);
+    for(i=j+1;i<nm && isnan(t.mle[i]);++i);
+    if(i<nm) b = min(b, t.mle[i]);
+    try
+    {
+      bracket = boost::math::tools::toms748_solve(f, a, b, tol, max_iter);
+    } catch(...)
+    {
+      return 0;
+    }
+    root    = bracket.first;
+    if((f(bracket.first) * f(bracket.second)) >0) root = NAN;
+  } else if(mu<x)
+  {
+    f.inv(true);
+    for(i=j+1;i<nm && isnan(t.mle[i]);++i);
+    if(i<nm) a = max(a, 1/t.mle[i]);
+    for(i=min(j,nm)-1;i>=0 && isnan(t.mle[i]);--i);
+    if(i>=0) b = min(b, 1/t.mle[i]);
+    try
+    {
+      bracket = boost::math::tools::toms748_solve(f, a, b, tol, max_iter);
+    } catch(...)
+    {
+      return 0;
+    }
+    root    = 1/bracket.first;
+    if((f(bracket.first) * f(bracket.second)) >0) root = NAN;
+  } else
+  {
+    root = 1;
+  }
+  if(j < nm) t.mle[j] = root;
+  return root;
+}
+
+/* The lower (or upper) tail probability of q under the noncentral
+ * hypergeometric distribution with the given odds ratio, less alpha: the
+ * function whose root is a confidence bound for the odds ratio. With invert
+ * set the argument is the reciprocal of the odds ratio.
+ */
+class pnhyper
+{
+  hyper_support &s;
+  double q;
+  double alpha;
+  bool upper;
+  bool invert;
+
+  public:
+    pnhyper(hyper_support &S, double Q, double A, bool U, bool I) :
+      s(S), q(Q), alpha(A), upper(U), invert(I) {}
+    double operator()(double ncp)
+    {
+      int j, ns = s.ns;
+      double maxd, sumd, sum = 0;
+      if(invert) ncp = 1/ncp;
+      if(ncp == 0) return (upper ? q <= s.lo : q >= s.lo) - alpha;
+      if(isinf(ncp)) return (upper ? q <= s.hi : q >= s.hi) - alpha;
+      if(ns<=0) return -alpha;
+      if(s.wide)
+      {
+        hyper_wide w;
+        w.init(s, ncp);
+        return (upper ? w.p_greater(q) : w.p_less(q)) - alpha;
+      }
+      const double *support = &s.support[0];
+      double *d = &s.d[0];
+      maxd = kernels.axpy_max(d, &s.logdc[0], log(ncp), support, ns);
+      sumd = kernels.exp_sum(d, maxd, ns);
+      for(j=0;j<ns;++j)
+      {
+        if(upper ? support[j] >= q : support[j] <= q) sum = sum + d[j];
+      }
+      return sum/sumd - alpha;
+    }
+};
+
+static double
+ncp_root(pnhyper f, double a, double b)
+{
+  boost::uintmax_t max_iter=5000;
+  boost::math::tools::eps_tolerance<double> tol(52);
+  std::pair<double, double> bracket;
+  try
+  {
+    bracket = boost::math::tools::toms748_solve(f, a, b, tol, max_iter);
+  } catch(...)
+  {
+    return NAN;
+  }
+  return bracket.first;
+}
+
+/* The upper confidence bound of the odds ratio at level 1 - alpha, R's ncp.U */
+static double
+ncp_upper(hyper_table &t, double x, double alpha)
+{
+  if(x >= t.hi) return INFINITY;
+  double p = t.p_less(x);
+  if(p < alpha) return ncp_root(pnhyper(t, x, alpha, false, false), 0, 1);
+  if(p > alpha) return 1/ncp_root(pnhyper(t, x, alpha, false, true), DBL_EPSILON, 1);
+  return 1;
+}
+
+/* The lower confidence bound of the odds ratio at level 1 - alpha, R's ncp.L */
+static double
+ncp_lower(hyper_table &t, double x, double alpha)
+{
+  if(x <= t.lo) return 0;
+  double p = t.p_greater(x);
+  if(p > alpha) return ncp_root(pnhyper(t, x, alpha, true, false), 0, 1);
+  if(p < alpha) return 1/ncp_root(pnhyper(t, x, alpha, true, true), DBL_EPSILON, 1);
+  return 1;
+}
+
+/*
+ * @brief Fisher exact test conditional odds ratio
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @returns The conditional odds ratio for the one-tailed Fisher exact test.
+ */
+static void
+superfun_conditional_odds_ratio(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() )    
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  res->setDouble(hyper_mle(x, m, n, k));
+}
+
+/*
+ * @brief Fisher exact test p-value
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @param alternative (string) one of {"less","greater","two.sided"}
+ * @returns The Fisher exact test p-value.
+ */
+static void
+superfun_fisher_p_value(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() || 
+     args[4]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  string a = args[4]->getString();
+  hyper_table &t = hyper_lookup(m,n,k);
+  if(a == "less")
+  {
+    res->setDouble(t.p_less(x));
+    return;
+  }
+  if(a == "greater")
+  {
+    res->setDouble(t.p_greater(x));
+    return;
+  }
+// Default to two.sided
+  res->setDouble(t.p_two_sided(x));
+}
+
+/*
+ * @brief The natural log of the Fisher exact test p-value
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @param alternative (string) one of {"less","greater","two.sided"}
+ * @returns log(fishertest_p_value), computed in log space throughout so that
+ * it stays finite where the p-value itself underflows to zero.
+ */
+static void
+superfun_fisher_log_p_value(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() || 
+     args[4]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  string a = args[4]->getString();
+  if(a == "less")
+  {
+    res->setDouble(phyper(floor(x), m, n, k, 1, 1));
+    return;
+  }
+  if(a == "greater")
+  {
+    res->setDouble(phyper(ceil(x) - 1, m, n, k, 0, 1));
+    return;
+  }
+// Default to two.sided, with the relative error of fishertest_p_value
+  hyper_wide w;
+  w.locate(m, n, k, 1);
+  res->setDouble(w.log_p_two_sided(x, 1.000000001, false));
+}
+
+/* The result of fisher_test, also the fisher type itself */
+struct Fisher
+{
+  double p_value;
+  double odds_ratio;
+  double conf_lower;
+  double conf_upper;
+};
+
+static inline Fisher
+fisher_value(const Value *v)
+{
+  Fisher f;
+  memcpy(&f, v->data(), sizeof(Fisher));
+  return f;
+}
+
+static void
+fisher_test(double x, double m, double n, double k, string const& a, double conf_level, Value *res)
+{
+  Fisher f;
+  hyper_table &t = hyper_lookup(m,n,k);
+  double alpha = 1 - conf_level;
+  bool level = conf_level > 0 && conf_level < 1;
+  f.odds_ratio = hyper_mle(x, m, n, k);
+  f.conf_lower = f.conf_upper = NAN;
+  if(a == "less")
+  {
+    f.p_value = t.p_less(x);
+    if(level)
+    {
+      f.conf_lower = 0;
+      f.conf_upper = ncp_upper(t, x, alpha);
+    }
+  } else if(a == "greater")
+  {
+    f.p_value = t.p_greater(x);
+    if(level)
+    {
+      f.conf_lower = ncp_lower(t, x, alpha);
+      f.conf_upper = INFINITY;
+    }
+  } else
+  {
+// Default to two.sided
+    f.p_value = t.p_two_sided_r(x);
+    if(level)
+    {
+      f.conf_lower = ncp_lower(t, x, alpha/2);
+      f.conf_upper = ncp_upper(t, x, alpha/2);
+    }
+  }
+  res->setData(&f, sizeof(Fisher));
+}
+
+/*
+ * @brief Fisher's exact test of a 2x2 table, as R's fisher.test
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @param alternative (string) one of {"less","greater","two.sided"}
+ * @param conf_level (double) The confidence level of the odds ratio interval
+ * @returns The p-value, conditional odds ratio estimate and its confidence
+ * interval, all from the same hypergeometric table.
+ */
+static void
+superfun_fisher_test(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() || 
+     args[4]->isNull() ||
+     args[5]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  fisher_test(args[0]->getDouble(), args[1]->getDouble(), args[2]->getDouble(),
+              args[3]->getDouble(), args[4]->getString(), args[5]->getDouble(), res);
+}
+
+/* fisher_test with a two-sided alternative and a 95% confidence interval */
+static void
+superfun_fisher_test2(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() )    
+  {
+    res->setNull(0);
+    return;
+  }
+  fisher_test(args[0]->getDouble(), args[1]->getDouble(), args[2]->getDouble(),
+              args[3]->getDouble(), "two.sided", 0.95, res);
+}
+
+static void
+fisher_p_value(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(fisher_value(args[0]).p_value);
+}
+
+static void
+fisher_odds_ratio(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(fisher_value(args[0]).odds_ratio);
+}
+
+static void
+fisher_conf_lower(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(fisher_value(args[0]).conf_lower);
+}
+
+static void
+fisher_conf_upper(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(fisher_value(args[0]).conf_upper);
+}
+
+/* Show a Fisher test as p-value, odds ratio, lower and upper bound */
+static void
+fisher2string(const Value** args, Value *res, void*)
+{
+  char buf[128];
+  Fisher f = fisher_value(args[0]);
+  snprintf(buf, sizeof(buf), "%.15g, %.15g, %.15g, %.15g",
+           f.p_value, f.odds_ratio, f.conf_lower, f.conf_upper);
+  res->setString(buf);
+}
+
+/* contingency_test picks the exact test when any expected count is below
+ * this, after Cochran, and the chi-squared test otherwise
+ */
+#define CONTINGENCY_MIN_EXPECTED 5
+
+enum
+{
+  CONTINGENCY_EXACT,
+  CONTINGENCY_CHISQ,
+  CONTINGENCY_G
+};
+
+static const char *contingency_methods[] = {"exact", "chisq", "g"};
+
+/* The result of contingency_test, also the contingency type itself. The
+ * statistic of the exact test is NaN.
+ */
+struct Contingency
+{
+  double  p_value;
+  double  statistic;
+  int32_t method;
+};
+
+static inline Contingency
+contingency_value(const Value *v)
+{
+  Contingency c;
+  memcpy(&c, v->data(), sizeof(Contingency));
+  return c;
+}
+
+static void
+contingency_test(double x, double m, double n, double k, string const& method, Value *res)
+{
+  Contingency c;
+  double N = m + n;
+// The cells and their expected counts, row by row
+  double o[4] = {x, k - x, m - x, n - k + x};
+  double e[4] = {m*k/N, n*k/N, m*(N - k)/N, n*(N - k)/N};
+  if(method == "exact") c.method = CONTINGENCY_EXACT;
+  else if(method == "chisq") c.method = CONTINGENCY_CHISQ;
+  else if(method == "g") c.method = CONTINGENCY_G;
+  else if(method == "auto")
+  {
+    double emin = min(min(e[0], e[1]), min(e[2], e[3]));
+    c.method = emin < CONTINGENCY_MIN_EXPECTED ? CONTINGENCY_EXACT : CONTINGENCY_CHISQ;
+  } else
+  {
+    throw PLUGIN_USER_EXCEPTION("superfunpack", SCIDB_SE_UDO, SUPERFUN_ERROR_CONTINGENCY);
+  }
+  if(c.method == CONTINGENCY_EXACT)
+  {
+    c.statistic = NAN;
+    c.p_value = hyper_lookup(m, n, k).p_two_sided(x);
+  } else
+  {
+    if(c.method == CONTINGENCY_CHISQ)
+    {
+// Every cell is off its expected count by the same |delta|, so with Yates'
+// correction X^2 = (|delta| - 1/2)^2 (1/e11 + 1/e12 + 1/e21 + 1/e22)
+      double delta = fabs(x - e[0]);
+      double d = delta - min(0.5, delta);
+      c.statistic = d*d*N*N*N/(m*n*k*(N - k));
+    } else
+    {
+      c.statistic = 0;
+      for(int j = 0; j < 4; ++j) if(o[j] > 0) c.statistic += 2*o[j]*log(o[j]/e[j]);
+    }
+// The upper tail of chi-squared with one degree of freedom
+    c.p_value = erfc(sqrt(c.statistic/2));
+  }
+  res->setData(&c, sizeof(Contingency));
+}
+
+/*
+ * @brief A test of independence of a 2x2 table that picks the cheapest
+ * adequate method
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn.
+ * @param method (string) one of {"auto","exact","chisq","g"}, anything else
+ * is an error
+ * @returns The two-sided p-value, the test statistic and the method used.
+ * The auto method chooses only between two of them: Fisher's exact test
+ * when an expected count is below 5, and otherwise the chi-squared test
+ * with Yates' continuity correction. It never runs the G-test.
+ */
+static void
+superfun_contingency_test(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() ||
+     args[4]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  contingency_test(args[0]->getDouble(), args[1]->getDouble(), args[2]->getDouble(),
+                   args[3]->getDouble(), args[4]->getString(), res);
+}
+
+/* contingency_test with the auto method */
+static void
+superfun_contingency_test2(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() )
+  {
+    res->setNull(0);
+    return;
+  }
+  contingency_test(args[0]->getDouble(), args[1]->getDouble(), args[2]->getDouble(),
+                   args[3]->getDouble(), "auto", res);
+}
+
+static void
+contingency_p_value(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(contingency_value(args[0]).p_value);
+}
+
+static void
+contingency_statistic(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setDouble(contingency_value(args[0]).statistic);
+}
+
+static void
+contingency_method(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull())
+  {
+    res->setNull(args[0]->getMissingReason());
+    return;
+  }
+  res->setString(contingency_methods[contingency_value(args[0]).method]);
+}
+
+/* Show a contingency test as p-value, statistic, method */
+static void
+contingency2string(const Value** args, Value *res, void*)
+{
+  char buf[128];
+  Contingency c = contingency_value(args[0]);
+  snprintf(buf, sizeof(buf), "%.15g, %.15g, %s",
+           c.p_value, c.statistic, contingency_methods[c.method]);
+  res->setString(buf);
+}
+
+/*
+ * @brief Hypergeometric probability density function
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @returns The hypergeometric density at x.
+ */
+static void
+superfun_dhyper(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  res->setDouble(dhyper(x, m, n, k, 0));
+}
+
+/*
+ * @brief Hypergeometric log density
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @returns The natural log of the hypergeometric density at x.
+ */
+static void
+superfun_dhyper_log(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  res->setDouble(dhyper(x, m, n, k, 1));
+}
+
+/*
+ * @brief hypergeometric cumulative distribution
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @param lower_tail (boolean) TRUE for lower tail quantile, FALSE for upper.
+ * @returns The hypergeometric cumulative distribution up to x
+ */
+static void
+superfun_phyper(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() ||
+     args[4]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  bool lower_tail = args[4]->getBool();
+  res->setDouble(phyper(x, m, n, k, lower_tail, 0));
+}
+
+/*
+ * @brief hypergeometric log cumulative distribution
+ * @param x (double) The number of white balls drawn without replacement
+ *           from an urn that contains both black and white balls.
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @param lower_tail (boolean) TRUE for lower tail, FALSE for upper.
+ * @returns The natural log of phyper, summed in log space.
+ */
+static void
+superfun_phyper_log(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() ||
+     args[4]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double x = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  bool lower_tail = args[4]->getBool();
+  res->setDouble(phyper(x, m, n, k, lower_tail, 1));
+}
+
+/*
+ * @brief hypergeometric quantile function
+ * @param p (double) The probability (0 <= p <= 1)
+ * @param m (double) The number of white balls in the urn.
+ * @param n (double) The number of black balls in the urn.
+ * @param k (double) The number of balls drawn from the urn. 
+ * @param lower_tail (boolean) TRUE for lowe tail quantile, FALSE for upper.
+ * @returns The number of white balls drawn without replacement
+ *          from an urn that contains both black and white balls.
+ */
+static void
+superfun_qhyper(const Value** args, Value *res, void*)
+{
+  if(args[0]->isNull() ||
+     args[1]->isNull() ||
+     args[2]->isNull() ||
+     args[3]->isNull() ||
+     args[4]->isNull())
+  {
+    res->setNull(0);
+    return;
+  }
+  double p = args[0]->getDouble();
+  double m = args[1]->getDouble();
+  double n = args[2]->getDouble();
+  double k = args[3]->getDouble();
+  bool lower_tail = args[4]->getBool();
+  res->setDouble(qhyper(p, m, n, k, lower_tail, 0));
+}
+
+REGISTER_FUNCTION(dhyper, list_of("double")("double")("double")("double"), "double", superfun_dhyper);
+REGISTER_FUNCTION(phyper, list_of("double")("double")("double")("double")("bool"), "double", superfun_phyper);
+REGISTER_FUNCTION(dhyper_log, list_of("double")("double")("double")("double"), "double", superfun_dhyper_log);
+REGISTER_FUNCTION(phyper_log, list_of("double")("double")("double")("double")("bool"), "double", superfun_phyper_log);
+REGISTER_FUNCTION(qhyper, list_of("double")("double")("double")("double")("bool"), "double", superfun_qhyper);
+REGISTER_FUNCTION(fishertest_odds_ratio, list_of("double")("double")("double")("double"), "double", superfun_conditional_odds_ratio);
+REGISTER_FUNCTION(fishertest_p_value, list_of("double")("double")("double")("double")("string"), "double", superfun_fisher_p_value);
+REGISTER_FUNCTION(fishertest_log_p_value, list_of("double")("double")("double")("double")("string"), "double", superfun_fisher_log_p_value);
+REGISTER_TYPE(fisher, sizeof(Fisher));
+REGISTER_FUNCTION(fisher_test, list_of("double")("double")("double")("double")("string")("double"), "fisher", superfun_fisher_test);
+REGISTER_FUNCTION(fisher_test, list_of("double")("double")("double")("double"), "fisher", superfun_fisher_test2);
+REGISTER_FUNCTION(fisher_p_value, list_of("fisher"), "double", fisher_p_value);
+REGISTER_FUNCTION(fisher_odds_ratio, list_of("fisher"), "double", fisher_odds_ratio);
+REGISTER_FUNCTION(fisher_conf_lower, list_of("fisher"), "double", fisher_conf_lower);
+REGISTER_FUNCTION(fisher_conf_upper, list_of("fisher"), "double", fisher_conf_upper);
+REGISTER_CONVERTER(fisher, string, EXPLICIT_CONVERSION_COST, fisher2string);
+REGISTER_TYPE(contingency, sizeof(Contingency));
+REGISTER_FUNCTION(contingency_test, list_of("double")("double")("double")("double")("string"), "contingency", superfun_contingency_test);
+REGISTER_FUNCTION(contingency_test, list_of("double")("double")("double")("double"), "contingency", superfun_contingency_test2);
+REGISTER_FUNCTION(contingency_p_value, list_of("contingency"), "double", contingency_p_value);
+REGISTER_FUNCTION(contingency_statistic, list_of("contingency"), "double", contingency_statistic);
+REGISTER_FUNCTION(contingency_method, list_of("contingency"), "string", contingency_method);
+REGISTER_CONVERTER(contingency, string, EXPLICIT_CONVERSION_COST, contingency2string);
@@ -0,0 +1,42 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.  Copyright (C) 2008-2014 SciDB, Inc.
+*
+* Superfunpack is free software: you can redistribute it and/or modify it under
+* the terms of the GNU General Public License version 2 as published by the
+* Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND, INCLUDING
+* ANY IMPLIED WARRANTY OF MERCHANTABILITY, NON-INFRINGEMENT, OR FITNESS FOR A
+* PARTICULAR PURPOSE. See the GNU General Public License version 2 for the
+* complete license terms.
+*
+* END_COPYRIGHT
+*/
+
+#ifndef SUPERFUNPACK_H
+#define SUPERFUNPACK_H
+
+#include "system/ErrorsLibrary.h"
+
+/* Error codes of the superfunpack library. The corresponding messages are
+ * registered by the superfunpack class at the end of superfunpack.cpp.
+ */
+enum
+{
+  SUPERFUN_ERROR_REGEX = SCIDB_USER_ERROR_CODE_START,
+  SUPERFUN_ERROR_ASOF_JOIN,
+  SUPERFUN_ERROR_BOOK_TICK,
+  SUPERFUN_ERROR_BOOK_SIDE,
+  SUPERFUN_ERROR_BOOK_REPLAY,
+  SUPERFUN_ERROR_BOOK_FIELD,
+  SUPERFUN_ERROR_P_ADJUST,
+  SUPERFUN_ERROR_FISHER_RXC,
+  SUPERFUN_ERROR_ENRICHMENT,
+  SUPERFUN_ERROR_BOOK_TICK_SIZE,
+  SUPERFUN_ERROR_CONTINGENCY
+};
+
+#endif